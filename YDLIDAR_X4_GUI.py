@@ -11,6 +11,28 @@ max_radius = 10000
 cur_radius = 5000
 min_radius = 1000
 
+# Wire format from ydlidar_x4_driver/ydlidar_x4_udp.h
+UDP_MAGIC = 0x34584459
+UDP_VERSION = 1
+# magic, version, flags, count, seq, timestamp_ns
+UDP_HEADER = struct.Struct('<IBBHIQ')
+# distance in 1/4 mm, angle in 1/64 degree
+UDP_POINT = np.dtype([('distance_q2', '<u2'), ('angle_q6', '<i2')])
+# Points collected before the plot is redrawn
+POINTS_PER_FRAME = 500
+
+def parse_datagram(data):
+    """Return (seq, distances in mm, angles in degrees), or None if the datagram is not a version we understand"""
+    if len(data) < UDP_HEADER.size:
+        return None
+    magic, version, flags, count, seq, timestamp_ns = UDP_HEADER.unpack_from(data)
+    if magic != UDP_MAGIC or version != UDP_VERSION:
+        return None
+    if len(data) < UDP_HEADER.size + count * UDP_POINT.itemsize:
+        return None
+    points = np.frombuffer(data, dtype=UDP_POINT, count=count, offset=UDP_HEADER.size)
+    return seq, points['distance_q2'] / 4.0, points['angle_q6'] / 64.0
+
 def plot_lidar_data(ax, data_set, user_input):
     # Remove tuples with distance 0.00
     valid_data = [(distance, angle) for distance, angle in data_set if distance != 0.00]
@@ -66,7 +88,7 @@ def main():
     listener_thread.start()
 
     UDP_PORT = 6969
-    BUFFER_SIZE = 320  # Allocate room for 40 floating point values
+    BUFFER_SIZE = 2048  # Largest datagram is a 20 byte header and 255 points of 4 bytes
 
     # Create a UDP socket
     sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
@@ -98,41 +120,44 @@ def main():
     ax.set_facecolor('black')
     # Set a timeout of .01 seconds
     sock.settimeout(0.01)
-    recv_buffer = []
+    distances = []
+    angles = []
     prev_tuples = []
+    expected_seq = None
+    lost = 0
     # Continuously update and display the lidar plot
     while True:
         try:
             data, addr = sock.recvfrom(BUFFER_SIZE)
-            recv_buffer.extend(struct.unpack('80f', data))
-            if len(recv_buffer) < 1000:
+            parsed = parse_datagram(data)
+            if parsed is None:
+                continue
+            seq, packet_distances, packet_angles = parsed
+            # Sequence numbers are consecutive, a gap is datagrams lost on the link
+            gap = None if expected_seq is None else (seq - expected_seq) & 0xFFFFFFFF
+            if gap is not None and gap & 0x80000000:
+                # Behind expected_seq, a late (reordered) or duplicated datagram that was not lost
+                print("Late or duplicate datagram", seq)
+            else:
+                if gap:
+                    lost += gap
+                    print("Lost", lost, "datagrams")
+                expected_seq = (seq + 1) & 0xFFFFFFFF
+            distances.extend(packet_distances)
+            angles.extend(packet_angles)
+            if len(distances) < POINTS_PER_FRAME:
                 continue
 
-
-            # Initialize empty arrays to store even and odd-indexed values
-            even_values = []
-            odd_values = []
-
-            # Extract even and odd-indexed values
-            for i in range(len(recv_buffer)):
-                if i % 2 == 0:
-                    even_values.append(recv_buffer[i])
-                else:
-                    odd_values.append(recv_buffer[i])
-
-            # Convert the lists of values to NumPy arrays
-            even_values_array = np.array(even_values, dtype=float)
-            odd_values_array = np.array(odd_values, dtype=float)
-
-            # Create a list of tuples containing even and odd-indexed values, removing tuples where the first value is zero
-            distance_angle_tuple = [(distance, angle) for distance, angle in zip(even_values_array, odd_values_array) if distance != 0]
+            # Create a list of tuples containing distance and angle values, removing tuples where the distance is zero
+            distance_angle_tuple = [(distance, angle) for distance, angle in zip(distances, angles) if distance != 0]
             temp_tuples = distance_angle_tuple.copy()
             distance_angle_tuple.extend(prev_tuples)
             # Update and display lidar plot
             plot_lidar_data(ax, distance_angle_tuple, user_input)
             
             plt.draw()
-            recv_buffer.clear()
+            distances.clear()
+            angles.clear()
 
             #prev_tuples.clear()
             prev_tuples = temp_tuples
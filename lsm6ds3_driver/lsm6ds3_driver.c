@@ -1,8 +1,25 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/spi/spi.h>
+#include <linux/regmap.h>
+#include <linux/pm.h>
+#include <linux/pm_runtime.h>
+#include <linux/property.h>
 #include <linux/iio/iio.h>
 #include <linux/iio/sysfs.h>
+#include <linux/iio/buffer.h>
+#include <linux/iio/trigger_consumer.h>
+#include <linux/iio/triggered_buffer.h>
+#include <linux/iio/trigger.h>
+#include <linux/iio/events.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/of_irq.h>
+#include <linux/delay.h>
+#include <linux/bitfield.h>
+#include <linux/mutex.h>
+#include <linux/timekeeping.h>
+#include <asm/unaligned.h>
 #include "lsm6ds3_registers.h"
 
 /* Meta Information */
@@ -10,207 +27,1669 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Caleb Steinmetz");
 MODULE_DESCRIPTION("A simple driver for the LSM6DS3 IMU via SPI");
 
+//Number of bytes from OUTX_L_G to OUTZ_H_XL (gyro X,Y,Z then accel X,Y,Z)
+#define LSM6DS3_OUT_BURST_LEN 12
+//The 8 KB hardware FIFO holds 4096 16-bit words, a gyro+accel sample is 6 words
+#define LSM6DS3_FIFO_WORDS 4096
+#define LSM6DS3_FIFO_SAMPLE_WORDS 6
+#define LSM6DS3_FIFO_MAX_SAMPLES (LSM6DS3_FIFO_WORDS / LSM6DS3_FIFO_SAMPLE_WORDS)
+
+enum my_imu_sensor_id {
+	MY_IMU_ACCEL,
+	MY_IMU_GYRO,
+	MY_IMU_SENSORS,
+};
+
+struct my_imu_odr {
+        int val;
+        int val2;
+        u32 period_ns;
+        //Same bits for CTRL1_XL and CTRL2_G, FIFO_CTRL5 takes them shifted right by one
+        u8 bm;
+};
+
+static const struct my_imu_odr my_imu_odrs[] = {
+        { 12, 500000, 80000000, CTRL1_XL_12HZ_BM },
+        { 26, 0, 38461538, CTRL1_XL_26HZ_BM },
+        { 52, 0, 19230769, CTRL1_XL_52HZ_BM },
+        { 104, 0, 9615384, CTRL1_XL_104HZ_BM },
+        { 208, 0, 4807692, CTRL1_XL_208HZ_BM },
+        { 416, 0, 2403846, CTRL1_XL_416HZ_BM },
+        { 833, 0, 1200480, CTRL1_XL_833HZ_BM },
+        { 1660, 0, 602409, CTRL1_XL_1660HZ_BM },
+        { 3330, 0, 300300, CTRL1_XL_3330HZ_BM },
+        { 6660, 0, 150150, CTRL1_XL_6660HZ_BM },
+};
+
+static const int my_imu_odr_avail[] = {
+        12, 500000, 26, 0, 52, 0, 104, 0, 208, 0, 416, 0, 833, 0, 1660, 0, 3330, 0, 6660, 0,
+};
+
+struct my_imu_scale {
+        int nano;
+        u8 bm;
+};
+
+//Full scale divided by the 32768 counts of a 16-bit 2's comp sample, in g
+static const struct my_imu_scale my_imu_accel_scales[] = {
+        { 61035, CTRL1_XL_SCALE_2G_BM },
+        { 122070, CTRL1_XL_SCALE_4G_BM },
+        { 244140, CTRL1_XL_SCALE_8G_BM },
+        { 488281, CTRL1_XL_SCALE_16G_BM },
+};
+
+static const int my_imu_accel_scale_avail[] = {
+        0, 61035, 0, 122070, 0, 244140, 0, 488281,
+};
+
+//Full scale divided by 32768 counts, in dps
+static const struct my_imu_scale my_imu_gyro_scales[] = {
+        { 3814697, CTRL2_G_125_DPS_EN_BM },
+        { 7629394, CTRL2_G_250_DPS_BM },
+        { 15258789, CTRL2_G_500_DPS_BM },
+        { 30517578, CTRL2_G_1000_DPS_BM },
+        { 61035156, CTRL2_G_2000_DPS_BM },
+};
+
+static const int my_imu_gyro_scale_avail[] = {
+        0, 3814697, 0, 7629394, 0, 15258789, 0, 30517578, 0, 61035156,
+};
+
+struct my_imu_sensor {
+        u8 reg;
+        u8 odr_mask;
+        u8 fs_mask;
+        const struct my_imu_scale *scales;
+        const int *scale_avail;
+        unsigned int num_scales;
+        //The gyro tops out at 1.66 kHz
+        unsigned int num_odrs;
+};
+
+static const struct my_imu_sensor my_imu_sensors[MY_IMU_SENSORS] = {
+        [MY_IMU_ACCEL] = {
+            .reg = CTRL1_XL,
+            .odr_mask = CTRL1_XL_ODR_MASK,
+            .fs_mask = CTRL1_XL_SCALE_MASK,
+            .scales = my_imu_accel_scales,
+            .scale_avail = my_imu_accel_scale_avail,
+            .num_scales = ARRAY_SIZE(my_imu_accel_scales),
+            .num_odrs = ARRAY_SIZE(my_imu_odrs),
+        },
+        [MY_IMU_GYRO] = {
+            .reg = CTRL2_G,
+            .odr_mask = CTRL2_G_ODR_MASK,
+            .fs_mask = CTRL2_G_FS_MASK,
+            .scales = my_imu_gyro_scales,
+            .scale_avail = my_imu_gyro_scale_avail,
+            .num_scales = ARRAY_SIZE(my_imu_gyro_scales),
+            .num_odrs = 8,
+        },
+};
+
+//Timestamp counter LSB with TIMER_HR set, and the span of its 24 bits
+#define LSM6DS3_TS_TICK_NS 25000
+#define LSM6DS3_TS_WRAP_NS ((s64)LSM6DS3_TS_TICK_NS << 24)
+//A timestamp data set (6 bytes) follows gyro and accel on every FIFO tick
+#define LSM6DS3_FIFO_TS_WORDS 3
+
+//Idle time before the chip is put in power-down
+#define LSM6DS3_AUTOSUSPEND_MS 2000
+//Gyro turn-on is about 80 ms, leave room for the slowest accel ODR as well
+#define LSM6DS3_WAKE_TIMEOUT_US 200000
+
+//DEC_FIFO_* codes indexed by log2 of the decimation factor
+static const u8 my_imu_fifo_dec_codes[] = { 1, 2, 4, 5, 6, 7 };
+
 struct my_imu {
 	struct spi_device *client;
+        //Caches the CTRL* configuration, output/status/FIFO registers always go to the bus
+        struct regmap *regmap;
+        //Serializes multi-register SPI sequences and the per-device state they update
+        struct mutex lock;
+        //Last burst of OUTX_L_G..OUTZ_H_XL and when it was read
+        u8 snapshot[LSM6DS3_OUT_BURST_LEN];
+        s64 snapshot_ns;
+        bool snapshot_valid;
+        //Indexes into my_imu_odrs and the per sensor scale tables
+        u8 odr_idx[MY_IMU_SENSORS];
+        u8 scale_idx[MY_IMU_SENSORS];
+        //Buffer watermark in samples, FIFO mode is used when above one
+        unsigned int watermark;
+        bool fifo_enabled;
+        //FIFO runs at the faster ODR, the slower sensor stores one data set every fifo_dec ticks
+        u8 fifo_odr_idx;
+        unsigned int fifo_dec[MY_IMU_SENSORS];
+        unsigned int fifo_pattern_words;
+        //Host time of hardware timestamp zero and the last counter value seen, to unwrap it
+        s64 hwts_base_ns;
+        u32 hwts_last;
+        //DMA safe landing area for a full FIFO drain
+        u8 *fifo_buffer;
+        //Data-ready / FIFO watermark trigger, NULL when no interrupt is wired
+        struct iio_trigger *trig;
+        //INT1_CTRL or INT2_CTRL depending on which pin is wired
+        u8 int_ctrl_reg;
+        //Captured in hard IRQ context for the sample that raised the interrupt
+        s64 irq_timestamp;
+        //Set by runtime resume until the first fresh sample arrives
+        s64 wake_start_ns;
+        //Runtime resume to first sample of the most recent wake up
+        s64 wake_latency_ns;
+        //Embedded functions requested by userspace, accel axes are bits 0..2
+        bool ev_wake;
+        u8 ev_single_tap_axes;
+        u8 ev_double_tap_axes;
+        //6D orientation, one engine reports both directions
+        bool ev_6d_rising;
+        bool ev_6d_falling;
+        bool ev_step;
+        bool pedometer;
+        //Holds a runtime PM reference while any embedded function is on
+        bool functions_pm;
+};
+
+/*
+ * @brief Registers the chip updates on its own and that must never be served from the cache
+ */
+static bool my_imu_volatile_reg(struct device *dev, unsigned int reg) {
+        switch(reg)
+        {
+            //Read by probe only, caching it would make regcache_sync write it back
+            case WHO_AM_I:
+            case WAKE_UP_SRC ... STATUS_REG:
+            case OUT_TEMP_L ... FIFO_DATA_OUT_H:
+            case TIMESTAMP0_REG ... TIMESTAMP2_REG:
+            case STEP_TIMESTAMP_L ... FUNC_SRC:
+            case OUT_MAG_RAW_X_L ... OUT_MAG_RAW_Z_H:
+                return true;
+            default:
+                return false;
+        }
+}
+
+/*
+ * @brief Registers a read changes, popping the FIFO or clearing latched event sources
+ * Keeps the regmap debugfs dump from eating samples and events
+ */
+static bool my_imu_precious_reg(struct device *dev, unsigned int reg) {
+        switch(reg)
+        {
+            case WAKE_UP_SRC ... D6D_SRC:
+            case FIFO_DATA_OUT_L ... FIFO_DATA_OUT_H:
+            case FUNC_SRC:
+                return true;
+            default:
+                return false;
+        }
+}
+
+/*
+ * @brief Control registers, the only ones regcache_sync may write back after a power down
+ */
+static bool my_imu_writeable_reg(struct device *dev, unsigned int reg) {
+        switch(reg)
+        {
+            case FUNC_CFG_ACCESS:
+            case SENSOR_SYNC_TIME_FRAME:
+            case FIFO_CTRL1 ... FIFO_CTRL5:
+            case ORIENT_CFG_G:
+            case INT1_CTRL ... INT2_CTRL:
+            case CTRL1_XL ... MASTER_CONFIG:
+            //Writing 0xAA resets the timestamp counter
+            case TIMESTAMP2_REG:
+            case TAP_CFG ... MD2_CFG:
+                return true;
+            default:
+                return false;
+        }
+}
+
+/*
+ * @brief FIFO_DATA_OUT is read as a stream of words from a single address
+ */
+static bool my_imu_noinc_reg(struct device *dev, unsigned int reg) {
+        return reg == FIFO_DATA_OUT_L;
+}
+
+static const struct regmap_config my_imu_regmap_config = {
+	.reg_bits = 8,
+	.val_bits = 8,
+	.read_flag_mask = LSM6DS3_SPI_READ_STROBE_BM,
+	.write_flag_mask = LSM6DS3_SPI_WRITE_STROBE_BM,
+	.max_register = OUT_MAG_RAW_Z_H,
+	.writeable_reg = my_imu_writeable_reg,
+	.volatile_reg = my_imu_volatile_reg,
+	.precious_reg = my_imu_precious_reg,
+	.readable_noinc_reg = my_imu_noinc_reg,
+	.cache_type = REGCACHE_RBTREE,
 };
 
-static int my_imu_read_raw(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, int *val, int *val2, long mask) {
+static enum my_imu_sensor_id my_imu_chan_sensor(struct iio_chan_spec const * chan) {
+        return chan->type == IIO_ANGL_VEL ? MY_IMU_GYRO : MY_IMU_ACCEL;
+}
+
+/*
+ * @brief Time between new samples from the faster of the two sensors
+ */
+static u32 my_imu_sample_period_ns(struct my_imu *imu) {
+        return my_imu_odrs[max(imu->odr_idx[MY_IMU_ACCEL], imu->odr_idx[MY_IMU_GYRO])].period_ns;
+}
+
+/*
+ * @brief Writes the cached ODR and full scale of one sensor to its control register
+ */
+static int my_imu_write_ctrl(struct my_imu *imu, enum my_imu_sensor_id id) {
+        const struct my_imu_sensor *sensor = &my_imu_sensors[id];
+
+        //Read-modify-write comes out of the cache, only the write goes over the bus
+        return regmap_update_bits(imu->regmap, sensor->reg, sensor->odr_mask | sensor->fs_mask,
+                my_imu_odrs[imu->odr_idx[id]].bm | sensor->scales[imu->scale_idx[id]].bm);
+}
+
+/*
+ * @brief Reads all six output registers in a single auto-increment SPI transfer
+ */
+static int my_imu_read_burst(struct my_imu *imu, u8 *buffer) {
+        //IF_INC in CTRL3_C makes the chip step through OUTX_L_G..OUTZ_H_XL for us
+        return regmap_bulk_read(imu->regmap, OUTX_L_G, buffer, LSM6DS3_OUT_BURST_LEN);
+}
+
+/*
+ * @brief Restarts the hardware timestamp counter and anchors it to the IIO clock
+ *
+ * The anchor follows current_timestamp_clock, set it to boottime to correlate with CLOCK_BOOTTIME.
+ */
+static int my_imu_hwts_reset(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret;
+
+        ret = regmap_write(imu->regmap, TIMESTAMP2_REG, TIMESTAMP2_RESET_VAL);
+        imu->hwts_base_ns = iio_get_time_ns(indio_dev);
+        imu->hwts_last = 0;
+        return ret;
+}
+
+/*
+ * @brief Converts a 24-bit hardware timestamp into IIO clock nanoseconds
+ */
+static s64 my_imu_hwts_to_ns(struct my_imu *imu, u32 ticks) {
+        if(ticks < imu->hwts_last)
+        {
+            imu->hwts_base_ns += LSM6DS3_TS_WRAP_NS;
+        }
+        imu->hwts_last = ticks;
+        return imu->hwts_base_ns + (s64)ticks * LSM6DS3_TS_TICK_NS;
+}
+
+/*
+ * @brief Keeps the hardware timebase from drifting away from the host clock
+ */
+static void my_imu_hwts_correct(struct my_imu *imu, s64 newest_ns, s64 now) {
+        //A sample can never be newer than the moment it was read, step back immediately
+        if(newest_ns > now)
+        {
+            imu->hwts_base_ns -= newest_ns - now;
+        }
+        //Otherwise pull slowly forward, the gap also holds read latency so it is heavily filtered
+        else
+        {
+            imu->hwts_base_ns += (now - newest_ns) >> 8;
+        }
+}
+
+/*
+ * @brief Drains every complete sample from the hardware FIFO in one burst and pushes them to the buffer
+ */
+static int my_imu_fifo_drain(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        struct {
+            __le16 channels[6];
+            s64 timestamp __aligned(8);
+        } scan;
+        unsigned int dec_xl = imu->fifo_dec[MY_IMU_ACCEL];
+        unsigned int dec_g = imu->fifo_dec[MY_IMU_GYRO];
+        unsigned int pattern_words = imu->fifo_pattern_words;
+        unsigned int words, pattern, periods, ticks, t;
+        s64 sample_ns = 0;
+        u32 hwts;
+        u8 status[4];
+        u8 *sample;
+        int ret;
+
+        ret = regmap_bulk_read(imu->regmap, FIFO_STATUS1, status, sizeof(status));
+        if(ret < 0)
+        {
+            return ret;
+        }
+        if(status[1] & FIFO_STATUS2_OVER_RUN_BM)
+        {
+            dev_warn_ratelimited(&imu->client->dev, "FIFO overrun, samples were lost");
+        }
+        words = ((status[1] & FIFO_STATUS2_DIFF_H_MASK) << 8) | status[0];
+        pattern = ((status[3] & FIFO_STATUS4_PATTERN_H_MASK) << 8) | status[2];
+
+        //Realign on the start of the pattern if the previous drain was interrupted mid sample
+        if(pattern != 0 && words >= pattern_words - pattern)
+        {
+            ret = regmap_noinc_read(imu->regmap, FIFO_DATA_OUT_L, imu->fifo_buffer, 2 * (pattern_words - pattern));
+            if(ret < 0)
+            {
+                return ret;
+            }
+            words -= pattern_words - pattern;
+        }
+
+        periods = min_t(unsigned int, words, LSM6DS3_FIFO_WORDS) / pattern_words;
+        if(periods == 0)
+        {
+            return 0;
+        }
+
+        //FIFO_DATA_OUT_H wraps back to FIFO_DATA_OUT_L, so one long read pops consecutive words
+        ret = regmap_noinc_read(imu->regmap, FIFO_DATA_OUT_L, imu->fifo_buffer, periods * pattern_words * 2);
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        memset(&scan, 0, sizeof(scan));
+        sample = imu->fifo_buffer;
+        ticks = periods * max(dec_xl, dec_g);
+        for(t = 0; t < ticks; t++)
+        {
+            //Data sets are stored gyro then accel, a decimated sensor keeps its last value in between
+            if(t % dec_g == 0)
+            {
+                memcpy(&scan.channels[3], sample, 6);
+                sample += 6;
+            }
+            if(t % dec_xl == 0)
+            {
+                memcpy(&scan.channels[0], sample, 6);
+                sample += 6;
+            }
+            //The timestamp data set is stored every tick as TS[15:8], TS[23:16], -, TS[7:0], STEP
+            hwts = (sample[1] << 16) | (sample[0] << 8) | sample[3];
+            sample += 6;
+            sample_ns = my_imu_hwts_to_ns(imu, hwts);
+            iio_push_to_buffers_with_timestamp(indio_dev, &scan, sample_ns);
+        }
+        my_imu_hwts_correct(imu, sample_ns, iio_get_time_ns(indio_dev));
+
+        return ticks;
+}
+
+/*
+ * @brief Records how long the chip took from runtime resume to its first sample
+ *
+ * Called with imu->lock held.
+ */
+static void my_imu_note_first_sample(struct my_imu *imu) {
+        if(imu->wake_start_ns)
+        {
+            imu->wake_latency_ns = ktime_get_ns() - imu->wake_start_ns;
+            imu->wake_start_ns = 0;
+        }
+}
+
+/*
+ * @brief Waits until both sensors have produced a sample after power-up
+ *
+ * Called with imu->lock held.
+ */
+static int my_imu_wait_first_sample(struct my_imu *imu) {
+        unsigned int status;
+        int ret;
+
+        ret = regmap_read_poll_timeout(imu->regmap, STATUS_REG, status,
+                (status & (STATUS_REG_XLDA_BM | STATUS_REG_GDA_BM)) == (STATUS_REG_XLDA_BM | STATUS_REG_GDA_BM),
+                1000, LSM6DS3_WAKE_TIMEOUT_US);
+        if(ret == 0)
+        {
+            my_imu_note_first_sample(imu);
+        }
+        return ret;
+}
+
+/*
+ * @brief Returns one axis from the cached output snapshot, refreshing it once per sample period
+ */
+static int my_imu_read_axis(struct my_imu *imu, struct iio_chan_spec const * chan, int *val) {
+        unsigned int offset;
+        s64 now;
+        int ret = 0;
+
+        //Registers hold gyro X,Y,Z then accel X,Y,Z, scan_index holds accel first
+        if(chan->type == IIO_INCLI && chan->scan_index < 3)
+        {
+            offset = 6 + 2 * chan->scan_index;
+        }
+        else if(chan->type == IIO_ANGL_VEL && chan->scan_index >= 3 && chan->scan_index < 6)
+        {
+            offset = 2 * (chan->scan_index - 3);
+        }
+        else
+        {
+            dev_err(&imu->client->dev, "Error, invalid channel");
+            return -EINVAL;
+        }
+
+        mutex_lock(&imu->lock);
+        if(imu->wake_start_ns)
+        {
+            ret = my_imu_wait_first_sample(imu);
+            if(ret < 0)
+            {
+                mutex_unlock(&imu->lock);
+                dev_err(&imu->client->dev, "No data after power-up");
+                return ret;
+            }
+        }
+        now = ktime_get_ns();
+        //Only go over the bus when the chip has produced a new sample since the last burst
+        if(!imu->snapshot_valid || now - imu->snapshot_ns >= my_imu_sample_period_ns(imu))
+        {
+            ret = my_imu_read_burst(imu, imu->snapshot);
+            if(ret < 0)
+            {
+                imu->snapshot_valid = false;
+                mutex_unlock(&imu->lock);
+                dev_err(&imu->client->dev, "Failed to read output registers");
+                return ret;
+            }
+            imu->snapshot_ns = now;
+            imu->snapshot_valid = true;
+        }
+        *val = (int16_t)get_unaligned_le16(&imu->snapshot[offset]);
+        mutex_unlock(&imu->lock);
+
+        return IIO_VAL_INT;
+}
+
+/*
+ * @brief Turns the embedded functions on or off to match what userspace asked for
+ *
+ * Called with imu->lock held. Every register here is cached, unchanged bits cost no bus traffic.
+ */
+static int my_imu_update_functions(struct my_imu *imu) {
+        u8 tap_axes = imu->ev_single_tap_axes | imu->ev_double_tap_axes;
+        bool pedometer = imu->pedometer || imu->ev_step;
+        u8 tap_cfg = 0;
+        u8 md2_cfg = 0;
+        unsigned int axis;
+        int ret;
+
+        for(axis = 0; axis < 3; axis++)
+        {
+            if(tap_axes & BIT(axis))
+            {
+                tap_cfg |= TAP_CFG_TAP_X_EN_BM >> axis;
+            }
+        }
+        if(pedometer)
+        {
+            tap_cfg |= TAP_CFG_PEDO_EN_BM;
+        }
+        ret = regmap_update_bits(imu->regmap, TAP_CFG, TAP_CFG_TAP_EN_MASK | TAP_CFG_PEDO_EN_BM, tap_cfg);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_update_bits(imu->regmap, WAKE_UP_THS, WAKE_UP_THS_SINGLE_DOUBLE_BM,
+                imu->ev_double_tap_axes ? WAKE_UP_THS_SINGLE_DOUBLE_BM : 0);
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        //Wake-up, tap and 6D are routed to INT2
+        if(imu->ev_wake)
+        {
+            md2_cfg |= MD2_CFG_WU_BM;
+        }
+        if(imu->ev_single_tap_axes)
+        {
+            md2_cfg |= MD2_CFG_SINGLE_TAP_BM;
+        }
+        if(imu->ev_double_tap_axes)
+        {
+            md2_cfg |= MD2_CFG_DOUBLE_TAP_BM;
+        }
+        if(imu->ev_6d_rising || imu->ev_6d_falling)
+        {
+            md2_cfg |= MD2_CFG_6D_BM;
+        }
+        ret = regmap_write(imu->regmap, MD2_CFG, md2_cfg);
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        ret = regmap_update_bits(imu->regmap, CTRL10_C, CTRL10_C_FUNC_EN_BM, pedometer ? CTRL10_C_FUNC_EN_BM : 0);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        //The step detector only exists on INT1, next to data-ready
+        return regmap_update_bits(imu->regmap, INT1_CTRL, INT1_CTRL_STEP_DET_BM, imu->ev_step ? INT1_CTRL_STEP_DET_BM : 0);
+}
+
+static bool my_imu_functions_active(struct my_imu *imu) {
+        return imu->ev_wake || imu->ev_single_tap_axes || imu->ev_double_tap_axes ||
+                imu->ev_6d_rising || imu->ev_6d_falling || imu->ev_step || imu->pedometer;
+}
+
+/*
+ * @brief Wakes the chip and takes the lock before an embedded function change
+ */
+static int my_imu_functions_begin(struct my_imu *imu) {
+        int ret;
+
+        ret = pm_runtime_resume_and_get(&imu->client->dev);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        mutex_lock(&imu->lock);
+        return 0;
+}
+
+/*
+ * @brief Applies the change and keeps the chip awake for as long as any function is on
+ */
+static int my_imu_functions_end(struct my_imu *imu) {
+        bool active;
+        bool was_active = imu->functions_pm;
+        int ret;
+
+        ret = my_imu_update_functions(imu);
+        active = my_imu_functions_active(imu);
+        imu->functions_pm = active;
+        mutex_unlock(&imu->lock);
+
+        pm_runtime_mark_last_busy(&imu->client->dev);
+        //Keep the reference from begin when the first function comes on, drop both with the last one
+        if(!active || was_active)
+        {
+            pm_runtime_put_autosuspend(&imu->client->dev);
+        }
+        if(!active && was_active)
+        {
+            pm_runtime_put_autosuspend(&imu->client->dev);
+        }
+
+        return ret;
+}
+
+/*
+ * @brief Step counter reads and pedometer enable
+ */
+static int my_imu_read_steps(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, int *val, long mask) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        __le16 steps;
+        int ret;
+
+        if(mask == IIO_CHAN_INFO_ENABLE)
+        {
+            *val = imu->pedometer;
+            return IIO_VAL_INT;
+        }
+        if(mask != IIO_CHAN_INFO_RAW)
+        {
+            return -EINVAL;
+        }
+
+        ret = pm_runtime_resume_and_get(&imu->client->dev);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_bulk_read(imu->regmap, STEP_COUNTER_L, &steps, sizeof(steps));
+        pm_runtime_mark_last_busy(&imu->client->dev);
+        pm_runtime_put_autosuspend(&imu->client->dev);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        *val = le16_to_cpu(steps);
+        return IIO_VAL_INT;
+}
+
+static int my_imu_read_raw(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, int *val, int *val2, long mask) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        enum my_imu_sensor_id id;
+        int ret;
+
+        //The step counter is independent of the buffer
+	if(chan->type == IIO_STEPS)
+        {
+            return my_imu_read_steps(indio_dev, chan, val, mask);
+        }
+        //Check mask to see if request is for raw data
+	if(mask == IIO_CHAN_INFO_RAW)
+        {
+            //Single reads are not allowed while the buffer owns the device
+            ret = iio_device_claim_direct_mode(indio_dev);
+            if(ret)
+            {
+                return ret;
+            }
+            ret = pm_runtime_resume_and_get(&imu->client->dev);
+            if(ret == 0)
+            {
+                ret = my_imu_read_axis(imu, chan, val);
+                pm_runtime_mark_last_busy(&imu->client->dev);
+                pm_runtime_put_autosuspend(&imu->client->dev);
+            }
+            iio_device_release_direct_mode(indio_dev);
+            return ret;
+	}
+        //Check mask to see if request is for scale
+        else if(mask == IIO_CHAN_INFO_SCALE)
+        {
+             id = my_imu_chan_sensor(chan);
+             *val = 0;
+             *val2 = my_imu_sensors[id].scales[imu->scale_idx[id]].nano;
+             return IIO_VAL_INT_PLUS_NANO;
+        }
+        //Check mask to see if request is for the output data rate
+        else if(mask == IIO_CHAN_INFO_SAMP_FREQ)
+        {
+             id = my_imu_chan_sensor(chan);
+             *val = my_imu_odrs[imu->odr_idx[id]].val;
+             *val2 = my_imu_odrs[imu->odr_idx[id]].val2;
+             return IIO_VAL_INT_PLUS_MICRO;
+        }
+        //Invalid mask, return error
+        dev_err(&imu->client->dev, "Error, invalid mask");
+        return -EINVAL;
+}
+
+static int my_imu_write_raw(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, int val, int val2, long mask) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        enum my_imu_sensor_id id = my_imu_chan_sensor(chan);
+        const struct my_imu_sensor *sensor = &my_imu_sensors[id];
+        u8 old_odr = imu->odr_idx[id];
+        u8 old_scale = imu->scale_idx[id];
+        unsigned int i;
+        int ret;
+
+        if(chan->type == IIO_STEPS)
+        {
+            if(mask != IIO_CHAN_INFO_ENABLE)
+            {
+                return -EINVAL;
+            }
+            ret = my_imu_functions_begin(imu);
+            if(ret < 0)
+            {
+                return ret;
+            }
+            imu->pedometer = !!val;
+            return my_imu_functions_end(imu);
+        }
+
+        //The FIFO pattern and buffer timestamps depend on the ODR, only change it while idle
+        ret = iio_device_claim_direct_mode(indio_dev);
+        if(ret)
+        {
+            return ret;
+        }
+
+        ret = -EINVAL;
+        mutex_lock(&imu->lock);
+        if(mask == IIO_CHAN_INFO_SAMP_FREQ)
+        {
+            for(i = 0; i < sensor->num_odrs; i++)
+            {
+                if(my_imu_odrs[i].val == val && my_imu_odrs[i].val2 == val2)
+                {
+                    imu->odr_idx[id] = i;
+                    ret = 0;
+                    break;
+                }
+            }
+        }
+        else if(mask == IIO_CHAN_INFO_SCALE)
+        {
+            for(i = 0; i < sensor->num_scales; i++)
+            {
+                if(val == 0 && sensor->scales[i].nano == val2)
+                {
+                    imu->scale_idx[id] = i;
+                    ret = 0;
+                    break;
+                }
+            }
+        }
+
+        if(ret == 0)
+        {
+            ret = my_imu_write_ctrl(imu, id);
+            if(ret < 0)
+            {
+                imu->odr_idx[id] = old_odr;
+                imu->scale_idx[id] = old_scale;
+            }
+            //The snapshot was taken with the old configuration
+            imu->snapshot_valid = false;
+        }
+        mutex_unlock(&imu->lock);
+        iio_device_release_direct_mode(indio_dev);
+
+        return ret;
+}
+
+static int my_imu_write_raw_get_fmt(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, long mask) {
+        if(mask == IIO_CHAN_INFO_SCALE)
+        {
+            return IIO_VAL_INT_PLUS_NANO;
+        }
+        return IIO_VAL_INT_PLUS_MICRO;
+}
+
+static int my_imu_read_avail(struct iio_dev * indio_dev, struct iio_chan_spec const * chan, const int **vals, int *type, int *length, long mask) {
+        const struct my_imu_sensor *sensor = &my_imu_sensors[my_imu_chan_sensor(chan)];
+
+        if(mask == IIO_CHAN_INFO_SAMP_FREQ)
+        {
+            *vals = my_imu_odr_avail;
+            *type = IIO_VAL_INT_PLUS_MICRO;
+            *length = 2 * sensor->num_odrs;
+            return IIO_AVAIL_LIST;
+        }
+        if(mask == IIO_CHAN_INFO_SCALE)
+        {
+            *vals = sensor->scale_avail;
+            *type = IIO_VAL_INT_PLUS_NANO;
+            *length = 2 * sensor->num_scales;
+            return IIO_AVAIL_LIST;
+        }
+        return -EINVAL;
+}
+
+static const struct iio_event_spec my_imu_accel_events[] = {
+    {
+        //Wake-up, threshold in FS/64 steps
+        .type = IIO_EV_TYPE_MAG,
+        .dir = IIO_EV_DIR_RISING,
+        .mask_shared_by_type = BIT(IIO_EV_INFO_VALUE) | BIT(IIO_EV_INFO_ENABLE),
+    },
+    {
+        //Tap, threshold in FS/32 steps, shared with double tap
+        .type = IIO_EV_TYPE_GESTURE,
+        .dir = IIO_EV_DIR_SINGLETAP,
+        .mask_separate = BIT(IIO_EV_INFO_ENABLE),
+        .mask_shared_by_type = BIT(IIO_EV_INFO_VALUE),
+    },
+    {
+        .type = IIO_EV_TYPE_GESTURE,
+        .dir = IIO_EV_DIR_DOUBLETAP,
+        .mask_separate = BIT(IIO_EV_INFO_ENABLE),
+    },
+    {
+        //6D orientation, rising when an axis points up
+        .type = IIO_EV_TYPE_CHANGE,
+        .dir = IIO_EV_DIR_RISING,
+        .mask_shared_by_type = BIT(IIO_EV_INFO_ENABLE),
+    },
+    {
+        //6D orientation, falling when an axis points down
+        .type = IIO_EV_TYPE_CHANGE,
+        .dir = IIO_EV_DIR_FALLING,
+        .mask_shared_by_type = BIT(IIO_EV_INFO_ENABLE),
+    },
+};
+
+static const struct iio_event_spec my_imu_step_events[] = {
+    {
+        .type = IIO_EV_TYPE_CHANGE,
+        .dir = IIO_EV_DIR_NONE,
+        .mask_separate = BIT(IIO_EV_INFO_ENABLE),
+    },
+};
+
+static const struct iio_chan_spec my_imu_channels[] = {
+    {
+        .type = IIO_INCLI,     // Channel type is inclinometer/accelerometer
+        .indexed = 1,          // Channel is numerically indexed
+        .channel = 0,          // Channel number within the sensor device
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW), // Specify available information (e.g., raw data)
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ), // Specify shared information (e.g., scale)
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ), // Values accepted by write_raw
+        .extend_name = "accel_x", // Extend the channel name
+        .event_spec = my_imu_accel_events, // Embedded functions reported through the event fd
+        .num_event_specs = ARRAY_SIZE(my_imu_accel_events),
+        .scan_index = 0,       // Index for scan order
+        .scan_type = {
+            .sign = 's',        // Sign of the raw data ('s' for signed)
+            .realbits = 16,     // Number of bits in the raw data
+            .storagebits = 16,  // Number of bits to store the data
+            .shift = 0,         // Shift value for data alignment
+            .endianness = IIO_LE, // Endianness of the data (little-endian)
+        },
+    },
+    {
+        .type = IIO_INCLI,
+        .indexed = 1,
+        .channel = 1,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .extend_name = "accel_y",
+        .event_spec = my_imu_accel_events,
+        .num_event_specs = ARRAY_SIZE(my_imu_accel_events),
+        .scan_index = 1,
+        .scan_type = {
+            .sign = 's',
+            .realbits = 16,
+            .storagebits = 16,
+            .shift = 0,
+            .endianness = IIO_LE,
+        },
+    },
+    {
+        .type = IIO_INCLI,
+        .indexed = 1,
+        .channel = 2,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .extend_name = "accel_z",
+        .event_spec = my_imu_accel_events,
+        .num_event_specs = ARRAY_SIZE(my_imu_accel_events),
+        .scan_index = 2,
+        .scan_type = {
+            .sign = 's',
+            .realbits = 16,
+            .storagebits = 16,
+            .shift = 0,
+            .endianness = IIO_LE,
+        },
+    },
+    {
+        .type = IIO_ANGL_VEL,     // Channel type is for Gyroscopes
+        .indexed = 1,          // Channel is numerically indexed
+        .channel = 3,          // Channel number within the sensor device
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW), // Specify available information (e.g., raw data)
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ), // Specify shared information (e.g., scale)
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ), // Values accepted by write_raw
+        .extend_name = "gyro_x", // Extend the channel name
+        .scan_index = 3,       // Index for scan order
+        .scan_type = {
+            .sign = 's',        // Sign of the raw data ('s' for signed)
+            .realbits = 16,     // Number of bits in the raw data
+            .storagebits = 16,  // Number of bits to store the data
+            .shift = 0,         // Shift value for data alignment
+            .endianness = IIO_LE, // Endianness of the data (little-endian)
+        },
+    },
+    {
+        .type = IIO_ANGL_VEL,
+        .indexed = 1,
+        .channel = 4,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .extend_name = "gyro_y",
+        .scan_index = 4,
+        .scan_type = {
+            .sign = 's',
+            .realbits = 16,
+            .storagebits = 16,
+            .shift = 0,
+            .endianness = IIO_LE,
+        },
+    },
+    {
+        .type = IIO_ANGL_VEL,
+        .indexed = 1,
+        .channel = 5,
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
+        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .info_mask_shared_by_type_available = BIT(IIO_CHAN_INFO_SCALE) | BIT(IIO_CHAN_INFO_SAMP_FREQ),
+        .extend_name = "gyro_z",
+        .scan_index = 5,
+        .scan_type = {
+            .sign = 's',
+            .realbits = 16,
+            .storagebits = 16,
+            .shift = 0,
+            .endianness = IIO_LE,
+        },
+    },
+    IIO_CHAN_SOFT_TIMESTAMP(6),
+    {
+        .type = IIO_STEPS,     // Pedometer step counter, not part of the buffer
+        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW) | BIT(IIO_CHAN_INFO_ENABLE),
+        .scan_index = -1,
+        .event_spec = my_imu_step_events,
+        .num_event_specs = ARRAY_SIZE(my_imu_step_events),
+    },
+};
+
+//Index of the step counter in my_imu_channels
+#define MY_IMU_STEPS_CHANNEL 7
+
+//Scans always contain all six axes, the IIO core demuxes to the enabled subset
+static const unsigned long my_imu_scan_masks[] = {
+    GENMASK(5, 0),
+    0,
+};
+
+/*
+ * @brief Bottom half of the trigger, pushes one complete 6-axis scan into the buffer
+ */
+static irqreturn_t my_imu_trigger_handler(int irq, void *p) {
+	struct iio_poll_func *pf = p;
+	struct iio_dev *indio_dev = pf->indio_dev;
+	struct my_imu *imu = iio_priv(indio_dev);
+        u8 burst[LSM6DS3_OUT_BURST_LEN];
+        struct {
+            __le16 channels[6];
+            s64 timestamp __aligned(8);
+        } scan;
+        s64 timestamp;
+        int ret;
+
+        //Our own trigger is polled from the IRQ thread, so the top half timestamp is not set
+        if(iio_trigger_using_own(indio_dev))
+        {
+            timestamp = imu->irq_timestamp;
+        }
+        else
+        {
+            timestamp = pf->timestamp;
+        }
+
+        mutex_lock(&imu->lock);
+        my_imu_note_first_sample(imu);
+        if(imu->fifo_enabled)
+        {
+            ret = my_imu_fifo_drain(indio_dev);
+            mutex_unlock(&imu->lock);
+            if(ret < 0)
+            {
+                dev_err(&imu->client->dev, "Failed to drain FIFO");
+            }
+            goto done;
+        }
+
+        memset(&scan, 0, sizeof(scan));
+        ret = my_imu_read_burst(imu, burst);
+        mutex_unlock(&imu->lock);
+        if(ret < 0)
+        {
+            dev_err(&imu->client->dev, "Failed to read output registers");
+            goto done;
+        }
+        //Registers hold gyro then accel, scan_index order is accel then gyro
+        memcpy(&scan.channels[0], &burst[6], 6);
+        memcpy(&scan.channels[3], &burst[0], 6);
+        iio_push_to_buffers_with_timestamp(indio_dev, &scan, timestamp);
+
+done:
+	iio_trigger_notify_done(indio_dev->trig);
+	return IRQ_HANDLED;
+}
+
+static int my_imu_set_watermark(struct iio_dev *indio_dev, unsigned int val) {
+	struct my_imu *imu = iio_priv(indio_dev);
+
+        imu->watermark = clamp_t(unsigned int, val, 1, LSM6DS3_FIFO_MAX_SAMPLES);
+        return 0;
+}
+
+/*
+ * @brief Switches the chip into continuous FIFO mode when the buffer watermark asks for batching
+ *
+ * Called with imu->lock held.
+ */
+static int my_imu_fifo_enable(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        unsigned int dec_shift[MY_IMU_SENSORS];
+        unsigned int period_ticks, threshold, id;
+        u8 fifo_ctrl3;
+        int ret;
+
+        if(imu->watermark <= 1)
+        {
+            return 0;
+        }
+
+        //The FIFO is clocked by the faster sensor, each ODR step doubles the rate
+        imu->fifo_odr_idx = max(imu->odr_idx[MY_IMU_ACCEL], imu->odr_idx[MY_IMU_GYRO]);
+        for(id = 0; id < MY_IMU_SENSORS; id++)
+        {
+            dec_shift[id] = imu->fifo_odr_idx - imu->odr_idx[id];
+            if(dec_shift[id] >= ARRAY_SIZE(my_imu_fifo_dec_codes))
+            {
+                dev_err(&imu->client->dev, "Accel and gyro ODR are too far apart for the FIFO");
+                return -EINVAL;
+            }
+            imu->fifo_dec[id] = 1 << dec_shift[id];
+        }
+        period_ticks = max(imu->fifo_dec[MY_IMU_ACCEL], imu->fifo_dec[MY_IMU_GYRO]);
+        imu->fifo_pattern_words = 3 * (period_ticks / imu->fifo_dec[MY_IMU_ACCEL] +
+                period_ticks / imu->fifo_dec[MY_IMU_GYRO]) + LSM6DS3_FIFO_TS_WORDS * period_ticks;
+
+        //Threshold is counted in words and must stay below the FIFO size
+        threshold = DIV_ROUND_UP(imu->watermark, period_ticks) * imu->fifo_pattern_words;
+        threshold = min_t(unsigned int, threshold, LSM6DS3_FIFO_WORDS - imu->fifo_pattern_words);
+        ret = regmap_write(imu->regmap, FIFO_CTRL1, threshold & 0xFF);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        //Store the hardware timestamp as the fourth data set of every tick
+        ret = regmap_write(imu->regmap, FIFO_CTRL2, ((threshold >> 8) & FIFO_CTRL2_FTH_H_MASK) | FIFO_CTRL2_TIMER_PEDO_EN_BM);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_write(imu->regmap, FIFO_CTRL4, FIFO_CTRL4_DEC_DS4_NONE_BM);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        fifo_ctrl3 = FIELD_PREP(FIFO_CTRL3_DEC_G_MASK, my_imu_fifo_dec_codes[dec_shift[MY_IMU_GYRO]]) |
+                FIELD_PREP(FIFO_CTRL3_DEC_XL_MASK, my_imu_fifo_dec_codes[dec_shift[MY_IMU_ACCEL]]);
+        ret = regmap_write(imu->regmap, FIFO_CTRL3, fifo_ctrl3);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = my_imu_hwts_reset(indio_dev);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_write(imu->regmap, FIFO_CTRL5, (my_imu_odrs[imu->fifo_odr_idx].bm >> 1) | FIFO_CTRL5_MODE_CONT_BM);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        imu->fifo_enabled = true;
+
+        return 0;
+}
+
+/*
+ * @brief Keeps the chip powered for as long as the buffer is enabled, and sets up the FIFO
+ *
+ * The FIFO is programmed here rather than in postenable because the IIO core attaches the
+ * trigger in between, and set_trigger_state needs fifo_enabled to route FTH instead of DRDY_XL.
+ */
+static int my_imu_buffer_preenable(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret;
+
+        ret = pm_runtime_resume_and_get(&imu->client->dev);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        mutex_lock(&imu->lock);
+        ret = my_imu_fifo_enable(indio_dev);
+        mutex_unlock(&imu->lock);
+        if(ret < 0)
+        {
+            pm_runtime_put_autosuspend(&imu->client->dev);
+        }
+
+        return ret;
+}
+
+static int my_imu_buffer_predisable(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret = 0;
+
+        mutex_lock(&imu->lock);
+        if(imu->fifo_enabled)
+        {
+            imu->fifo_enabled = false;
+            //Bypass mode also empties the FIFO
+            ret = regmap_write(imu->regmap, FIFO_CTRL5, FIFO_CTRL5_MODE_BYPASS_BM);
+        }
+        mutex_unlock(&imu->lock);
+
+        return ret;
+}
+
+static int my_imu_buffer_postdisable(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+
+        pm_runtime_mark_last_busy(&imu->client->dev);
+        pm_runtime_put_autosuspend(&imu->client->dev);
+        return 0;
+}
+
+static const struct iio_buffer_setup_ops my_imu_buffer_ops = {
+	.preenable = my_imu_buffer_preenable,
+	.predisable = my_imu_buffer_predisable,
+	.postdisable = my_imu_buffer_postdisable,
+};
+
+/*
+ * @brief Routes data-ready, or FIFO watermark when batching, to the interrupt pin
+ */
+static int my_imu_set_trigger_state(struct iio_trigger *trig, bool state) {
+	struct iio_dev *indio_dev = iio_trigger_get_drvdata(trig);
+	struct my_imu *imu = iio_priv(indio_dev);
+        u8 burst[LSM6DS3_OUT_BURST_LEN];
+        u8 int_ctrl = 0;
+        int ret;
+
+        mutex_lock(&imu->lock);
+        if(state)
+        {
+            int_ctrl = imu->fifo_enabled ? INT1_CTRL_FTH_BM : INT1_CTRL_DRDY_XL_BM;
+        }
+        //Leave the step detector bit alone, it is owned by the event code
+        ret = regmap_update_bits(imu->regmap, imu->int_ctrl_reg, INT1_CTRL_DRDY_XL_BM | INT1_CTRL_FTH_BM, int_ctrl);
+        if(ret == 0 && state && !imu->fifo_enabled)
+        {
+            //Data-ready is latched, read once so a stale sample does not hold the line high
+            ret = my_imu_read_burst(imu, burst);
+        }
+        mutex_unlock(&imu->lock);
+
+        return ret;
+}
+
+static const struct iio_trigger_ops my_imu_trigger_ops = {
+	.set_trigger_state = my_imu_set_trigger_state,
+};
+
+static irqreturn_t my_imu_irq_handler(int irq, void *private) {
+	struct iio_dev *indio_dev = private;
+	struct my_imu *imu = iio_priv(indio_dev);
+
+        imu->irq_timestamp = iio_get_time_ns(indio_dev);
+        return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t my_imu_irq_thread(int irq, void *private) {
+	struct iio_dev *indio_dev = private;
+	struct my_imu *imu = iio_priv(indio_dev);
+        unsigned int func_src;
+        int ret;
+
+        //The step detector shares INT1 with data-ready, reading FUNC_SRC clears it
+        if(READ_ONCE(imu->ev_step))
+        {
+            mutex_lock(&imu->lock);
+            ret = regmap_read(imu->regmap, FUNC_SRC, &func_src);
+            mutex_unlock(&imu->lock);
+            if(ret == 0 && (func_src & FUNC_SRC_STEP_DETECTED_BM))
+            {
+                iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_STEPS, 0, IIO_EV_TYPE_CHANGE, IIO_EV_DIR_NONE),
+                        imu->irq_timestamp);
+            }
+        }
+
+        //Runs the buffer pollfunc right here, the line stays masked until it has read the data
+        iio_trigger_poll_chained(imu->trig);
+        return IRQ_HANDLED;
+}
+
+/*
+ * @brief Reports wake-up, tap and 6D events latched on INT2
+ */
+static irqreturn_t my_imu_event_thread(int irq, void *private) {
+	struct iio_dev *indio_dev = private;
+	struct my_imu *imu = iio_priv(indio_dev);
+        s64 timestamp = iio_get_time_ns(indio_dev);
+        u8 single_axes, double_axes;
+        bool wake, six_d_rising, six_d_falling;
+        unsigned int axis;
+        u8 src[3];
+        int ret;
+
+        mutex_lock(&imu->lock);
+        //WAKE_UP_SRC, TAP_SRC and D6D_SRC are adjacent, reading them also releases the latched line
+        ret = regmap_bulk_read(imu->regmap, WAKE_UP_SRC, src, sizeof(src));
+        wake = imu->ev_wake;
+        single_axes = imu->ev_single_tap_axes;
+        double_axes = imu->ev_double_tap_axes;
+        six_d_rising = imu->ev_6d_rising;
+        six_d_falling = imu->ev_6d_falling;
+        mutex_unlock(&imu->lock);
+        if(ret < 0)
+        {
+            //The line stays asserted and fires again, IRQ_NONE would get it disabled as spurious
+            dev_err_ratelimited(&imu->client->dev, "Failed to read event sources");
+            return IRQ_HANDLED;
+        }
+
+        for(axis = 0; axis < 3; axis++)
+        {
+            if(wake && (src[0] & WAKE_UP_SRC_WU_IA_BM) && (src[0] & (WAKE_UP_SRC_X_WU_BM >> axis)))
+            {
+                iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_INCLI, axis, IIO_EV_TYPE_MAG, IIO_EV_DIR_RISING),
+                        timestamp);
+            }
+            if(src[1] & (TAP_SRC_X_TAP_BM >> axis))
+            {
+                if((src[1] & TAP_SRC_SINGLE_TAP_BM) && (single_axes & BIT(axis)))
+                {
+                    iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_INCLI, axis, IIO_EV_TYPE_GESTURE, IIO_EV_DIR_SINGLETAP),
+                            timestamp);
+                }
+                if((src[1] & TAP_SRC_DOUBLE_TAP_BM) && (double_axes & BIT(axis)))
+                {
+                    iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_INCLI, axis, IIO_EV_TYPE_GESTURE, IIO_EV_DIR_DOUBLETAP),
+                            timestamp);
+                }
+            }
+            if(src[2] & D6D_SRC_D6D_IA_BM)
+            {
+                if(six_d_rising && (src[2] & (D6D_SRC_XH_BM << (2 * axis))))
+                {
+                    iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_INCLI, axis, IIO_EV_TYPE_CHANGE, IIO_EV_DIR_RISING),
+                            timestamp);
+                }
+                if(six_d_falling && (src[2] & (D6D_SRC_XL_BM << (2 * axis))))
+                {
+                    iio_push_event(indio_dev, IIO_UNMOD_EVENT_CODE(IIO_INCLI, axis, IIO_EV_TYPE_CHANGE, IIO_EV_DIR_FALLING),
+                            timestamp);
+                }
+            }
+        }
+
+        return IRQ_HANDLED;
+}
+
+/*
+ * @brief Wires INT2 for embedded-function events and drops event channels the board cannot deliver
+ */
+static int my_imu_setup_events(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+	struct spi_device *client = imu->client;
+        struct iio_chan_spec *channels;
+        unsigned long irq_flags;
+        unsigned int i;
+        int irq = 0;
+        int ret;
+
+        channels = devm_kmemdup(&client->dev, my_imu_channels, sizeof(my_imu_channels), GFP_KERNEL);
+        if(!channels)
+        {
+            return -ENOMEM;
+        }
+        indio_dev->channels = channels;
+
+        //Step events ride on the INT1 data-ready interrupt
+        if(!imu->trig || imu->int_ctrl_reg != INT1_CTRL)
+        {
+            channels[MY_IMU_STEPS_CHANNEL].num_event_specs = 0;
+        }
+
+        //INT2 is free for events unless it already carries the data-ready trigger
+        if(imu->int_ctrl_reg == INT1_CTRL)
+        {
+            irq = of_irq_get_byname(client->dev.of_node, "int2");
+            if(irq == -EPROBE_DEFER)
+            {
+                return irq;
+            }
+        }
+        if(irq <= 0)
+        {
+            for(i = 0; i < ARRAY_SIZE(my_imu_channels); i++)
+            {
+                if(channels[i].type == IIO_INCLI)
+                {
+                    channels[i].num_event_specs = 0;
+                }
+            }
+            return 0;
+        }
+
+        //Latch the sources until the event thread has read them, double tap needs wider windows than reset
+        ret = regmap_update_bits(imu->regmap, TAP_CFG, TAP_CFG_LIR_BM, TAP_CFG_LIR_BM);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_write(imu->regmap, INT_DUR2, 0x7F);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        //Default thresholds: wake-up at FS/32, tap at FS/4
+        ret = regmap_write(imu->regmap, WAKE_UP_THS, 0x02);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_write(imu->regmap, TAP_THS_6D, 0x08);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        ret = regmap_write(imu->regmap, MD2_CFG, 0);
+        if(ret < 0)
+        {
+            return ret;
+        }
+
+        irq_flags = irq_get_trigger_type(irq);
+        if(!irq_flags)
+        {
+            irq_flags = IRQF_TRIGGER_HIGH;
+        }
+        ret = devm_request_threaded_irq(&client->dev, irq, NULL, my_imu_event_thread,
+                irq_flags | IRQF_ONESHOT, dev_name(&client->dev), indio_dev);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to request event IRQ %d\n", irq);
+            return ret;
+        }
+
+        return 0;
+}
+
+/*
+ * @brief Looks up INT1 (or INT2) from the device tree and registers it as an IIO trigger
+ */
+static int my_imu_setup_trigger(struct iio_dev *indio_dev) {
+	struct my_imu *imu = iio_priv(indio_dev);
+	struct spi_device *client = imu->client;
+        unsigned long irq_flags;
+        int irq;
+        int ret;
+
+        imu->int_ctrl_reg = INT1_CTRL;
+        irq = of_irq_get_byname(client->dev.of_node, "int1");
+        if(irq == -EPROBE_DEFER)
+        {
+            return irq;
+        }
+        if(irq <= 0)
+        {
+            imu->int_ctrl_reg = INT2_CTRL;
+            irq = of_irq_get_byname(client->dev.of_node, "int2");
+            if(irq == -EPROBE_DEFER)
+            {
+                return irq;
+            }
+        }
+        if(irq <= 0)
+        {
+            imu->int_ctrl_reg = INT1_CTRL;
+            irq = client->irq;
+        }
+        if(irq <= 0)
+        {
+            dev_info(&client->dev, "No interrupt wired, only software triggers are available\n");
+            return 0;
+        }
+
+        imu->trig = devm_iio_trigger_alloc(&client->dev, "%s-dev%d", indio_dev->name, iio_device_id(indio_dev));
+        if(!imu->trig)
+        {
+            return -ENOMEM;
+        }
+        imu->trig->ops = &my_imu_trigger_ops;
+        iio_trigger_set_drvdata(imu->trig, indio_dev);
+
+        //Both interrupt sources are latched, a level trigger cannot lose an edge
+        irq_flags = irq_get_trigger_type(irq);
+        if(!irq_flags)
+        {
+            irq_flags = IRQF_TRIGGER_HIGH;
+        }
+        ret = devm_request_threaded_irq(&client->dev, irq, my_imu_irq_handler, my_imu_irq_thread,
+                irq_flags | IRQF_ONESHOT, dev_name(&client->dev), indio_dev);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to request IRQ %d\n", irq);
+            return ret;
+        }
+
+        ret = devm_iio_trigger_register(&client->dev, imu->trig);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to register trigger\n");
+            return ret;
+        }
+        //Use the hardware trigger by default
+        indio_dev->trig = iio_trigger_get(imu->trig);
+
+        return 0;
+}
+
+static int my_imu_read_event_config(struct iio_dev *indio_dev, const struct iio_chan_spec *chan,
+                enum iio_event_type type, enum iio_event_direction dir) {
 	struct my_imu *imu = iio_priv(indio_dev);
-        uint8_t low_byte, high_byte;
-        int16_t raw_value;
 
-        //Check mask to see if request is for raw data
-	if(mask == IIO_CHAN_INFO_RAW)
+        if(chan->type == IIO_STEPS)
         {
-            //Check type to see if request is for accelerometer data
-            if(chan->type == IIO_INCLI)
-            {
-                if (chan->channel == 0)
-                {
-                    //X-Axis
-                    low_byte = spi_w8r8(imu->client, OUTX_L_XL | LSM6DS3_SPI_READ_STROBE_BM);
-                    high_byte = spi_w8r8(imu->client,  OUTX_H_XL | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else if (chan->channel == 1)
-                {
-                    //Y-Axis
-	            low_byte =spi_w8r8(imu->client, OUTY_L_XL | LSM6DS3_SPI_READ_STROBE_BM);
-	            high_byte = spi_w8r8(imu->client, OUTY_H_XL | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else if (chan->channel == 2)
-                {
-                    //Z-Axis
-	            low_byte = spi_w8r8(imu->client, OUTZ_L_XL | LSM6DS3_SPI_READ_STROBE_BM);
-	            high_byte = spi_w8r8(imu->client, OUTZ_H_XL | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else
-                {
-                    pr_err("lsm6ds3_iio: Error, invalid channel value for IIO_INCLI");
-                    return -EINVAL;
-                }
-            }
-            //Check type to see if request is for gyroscope data
-            else if (chan->type == IIO_ANGL_VEL)
-            {
-                if (chan->channel == 3)
-                {
-                    //X-Axis
-                    low_byte = spi_w8r8(imu->client, OUTX_L_G | LSM6DS3_SPI_READ_STROBE_BM);
-                    high_byte = spi_w8r8(imu->client,  OUTX_H_G | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else if (chan->channel == 4)
-                {
-                    //Y-Axis
-	            low_byte =spi_w8r8(imu->client, OUTY_L_G | LSM6DS3_SPI_READ_STROBE_BM);
-	            high_byte = spi_w8r8(imu->client, OUTY_H_G | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else if (chan->channel == 5)
-                {
-                    //Z-Axis
-	            low_byte = spi_w8r8(imu->client, OUTZ_L_G | LSM6DS3_SPI_READ_STROBE_BM);
-	            high_byte = spi_w8r8(imu->client, OUTZ_H_G | LSM6DS3_SPI_READ_STROBE_BM);
-                }
-                else
-                {
-                    pr_err("lsm6ds3_iio: Error, invalid channel value for IIO_ANGL_VEL");
-                    return -EINVAL;
-                }
-            }
-            raw_value = (int16_t)((high_byte << 8) | low_byte);
-	    *val = (int)raw_value;
-            return IIO_VAL_INT;
-	}
-        //Check mask to see if request is for scale
-        else if(mask == IIO_CHAN_INFO_SCALE)
+            return imu->ev_step;
+        }
+        if(type == IIO_EV_TYPE_MAG)
         {
-             if(chan->type == IIO_ANGL_VEL)
-             {
-                 //Assume 250 DPS
-                 *val = 250;
-                 //Max absolute value of 16-bit 2's comp
-                 *val2 = 32768;
-                 return IIO_VAL_FRACTIONAL;
-             }
-
-             if(chan->type == IIO_INCLI)
-             {
-                 //Assume +-2G scale
-                 *val = 1;
-                 *val2 = 16384;
-                 return IIO_VAL_FRACTIONAL;
-             }
-             else
-             {
-                 pr_err("lsm6ds3_iio: Error, invalid channel type for scale");
-                 return -EINVAL;
-             }
+            return imu->ev_wake;
+        }
+        if(type == IIO_EV_TYPE_GESTURE && dir == IIO_EV_DIR_SINGLETAP)
+        {
+            return !!(imu->ev_single_tap_axes & BIT(chan->channel));
+        }
+        if(type == IIO_EV_TYPE_GESTURE && dir == IIO_EV_DIR_DOUBLETAP)
+        {
+            return !!(imu->ev_double_tap_axes & BIT(chan->channel));
+        }
+        if(type == IIO_EV_TYPE_CHANGE && dir == IIO_EV_DIR_RISING)
+        {
+            return imu->ev_6d_rising;
+        }
+        if(type == IIO_EV_TYPE_CHANGE && dir == IIO_EV_DIR_FALLING)
+        {
+            return imu->ev_6d_falling;
         }
-        //Invalid mask, return error
-        pr_err("lsm6ds3_iio: Error, invalid mask");
         return -EINVAL;
 }
 
-static const struct iio_chan_spec my_imu_channels[] = {
-    {
-        .type = IIO_INCLI,     // Channel type is inclinometer/accelerometer
-        .indexed = 1,          // Channel is numerically indexed
-        .channel = 0,          // Channel number within the sensor device
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW), // Specify available information (e.g., raw data)
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE), // Specify shared information (e.g., scale)
-        .extend_name = "accel_x", // Extend the channel name
-        .scan_index = 0,       // Index for scan order
-        .scan_type = {
-            .sign = 's',        // Sign of the raw data ('s' for signed)
-            .realbits = 16,     // Number of bits in the raw data
-            .storagebits = 16,  // Number of bits to store the data
-            .shift = 0,         // Shift value for data alignment
-            .endianness = IIO_LE, // Endianness of the data (little-endian)
-        },
-    },
-    {
-        .type = IIO_INCLI,
-        .indexed = 1,
-        .channel = 1,
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),
-        .extend_name = "accel_y",
-        .scan_index = 1,
-        .scan_type = {
-            .sign = 's',
-            .realbits = 16,
-            .storagebits = 16,
-            .shift = 0,
-            .endianness = IIO_LE,
-        },
-    },
-    {
-        .type = IIO_INCLI,
-        .indexed = 1,
-        .channel = 2,
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),
-        .extend_name = "accel_z",
-        .scan_index = 2,
-        .scan_type = {
-            .sign = 's',
-            .realbits = 16,
-            .storagebits = 16,
-            .shift = 0,
-            .endianness = IIO_LE,
-        },
-    },
-    {
-        .type = IIO_ANGL_VEL,     // Channel type is for Gyroscopes
-        .indexed = 1,          // Channel is numerically indexed
-        .channel = 3,          // Channel number within the sensor device
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW), // Specify available information (e.g., raw data)
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE), // Specify shared information (e.g., scale)
-        .extend_name = "gyro_x", // Extend the channel name
-        .scan_index = 3,       // Index for scan order
-        .scan_type = {
-            .sign = 's',        // Sign of the raw data ('s' for signed)
-            .realbits = 16,     // Number of bits in the raw data
-            .storagebits = 16,  // Number of bits to store the data
-            .shift = 0,         // Shift value for data alignment
-            .endianness = IIO_LE, // Endianness of the data (little-endian)
-        },
-    },
-    {
-        .type = IIO_ANGL_VEL,
-        .indexed = 1,
-        .channel = 4,
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),
-        .extend_name = "gyro_y",
-        .scan_index = 4,
-        .scan_type = {
-            .sign = 's',
-            .realbits = 16,
-            .storagebits = 16,
-            .shift = 0,
-            .endianness = IIO_LE,
-        },
-    },
-    {
-        .type = IIO_ANGL_VEL,
-        .indexed = 1,
-        .channel = 5,
-        .info_mask_separate = BIT(IIO_CHAN_INFO_RAW),
-        .info_mask_shared_by_type = BIT(IIO_CHAN_INFO_SCALE),
-        .extend_name = "gyro_z",
-        .scan_index = 5,
-        .scan_type = {
-            .sign = 's',
-            .realbits = 16,
-            .storagebits = 16,
-            .shift = 0,
-            .endianness = IIO_LE,
-        },
-    },
+static int my_imu_write_event_config(struct iio_dev *indio_dev, const struct iio_chan_spec *chan,
+                enum iio_event_type type, enum iio_event_direction dir, int state) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        u8 axis = BIT(chan->channel);
+        int ret;
+
+        ret = my_imu_functions_begin(imu);
+        if(ret < 0)
+        {
+            return ret;
+        }
+        if(chan->type == IIO_STEPS)
+        {
+            imu->ev_step = state;
+        }
+        else if(type == IIO_EV_TYPE_MAG)
+        {
+            imu->ev_wake = state;
+        }
+        else if(type == IIO_EV_TYPE_GESTURE && dir == IIO_EV_DIR_SINGLETAP)
+        {
+            imu->ev_single_tap_axes = state ? imu->ev_single_tap_axes | axis : imu->ev_single_tap_axes & ~axis;
+        }
+        else if(type == IIO_EV_TYPE_GESTURE && dir == IIO_EV_DIR_DOUBLETAP)
+        {
+            imu->ev_double_tap_axes = state ? imu->ev_double_tap_axes | axis : imu->ev_double_tap_axes & ~axis;
+        }
+        else if(type == IIO_EV_TYPE_CHANGE && dir == IIO_EV_DIR_RISING)
+        {
+            imu->ev_6d_rising = state;
+        }
+        else if(type == IIO_EV_TYPE_CHANGE && dir == IIO_EV_DIR_FALLING)
+        {
+            imu->ev_6d_falling = state;
+        }
+
+        return my_imu_functions_end(imu);
+}
+
+static int my_imu_read_event_value(struct iio_dev *indio_dev, const struct iio_chan_spec *chan,
+                enum iio_event_type type, enum iio_event_direction dir, enum iio_event_info info, int *val, int *val2) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        unsigned int reg;
+        int ret;
+
+        if(info != IIO_EV_INFO_VALUE)
+        {
+            return -EINVAL;
+        }
+        //Thresholds are cached, this works even while the chip is powered down
+        if(type == IIO_EV_TYPE_MAG)
+        {
+            ret = regmap_read(imu->regmap, WAKE_UP_THS, &reg);
+            *val = reg & WAKE_UP_THS_WK_THS_MASK;
+        }
+        else if(type == IIO_EV_TYPE_GESTURE)
+        {
+            ret = regmap_read(imu->regmap, TAP_THS_6D, &reg);
+            *val = reg & TAP_THS_6D_TAP_THS_MASK;
+        }
+        else
+        {
+            return -EINVAL;
+        }
+
+        return ret < 0 ? ret : IIO_VAL_INT;
+}
+
+static int my_imu_write_event_value(struct iio_dev *indio_dev, const struct iio_chan_spec *chan,
+                enum iio_event_type type, enum iio_event_direction dir, enum iio_event_info info, int val, int val2) {
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret;
+
+        if(info != IIO_EV_INFO_VALUE)
+        {
+            return -EINVAL;
+        }
+        mutex_lock(&imu->lock);
+        if(type == IIO_EV_TYPE_MAG && val >= 0 && val <= WAKE_UP_THS_WK_THS_MASK)
+        {
+            ret = regmap_update_bits(imu->regmap, WAKE_UP_THS, WAKE_UP_THS_WK_THS_MASK, val);
+        }
+        else if(type == IIO_EV_TYPE_GESTURE && val >= 0 && val <= TAP_THS_6D_TAP_THS_MASK)
+        {
+            ret = regmap_update_bits(imu->regmap, TAP_THS_6D, TAP_THS_6D_TAP_THS_MASK, val);
+        }
+        else
+        {
+            ret = -EINVAL;
+        }
+        mutex_unlock(&imu->lock);
+
+        return ret;
+}
+
+static ssize_t wake_latency_us_show(struct device *dev, struct device_attribute *attr, char *buf) {
+	struct my_imu *imu = iio_priv(dev_to_iio_dev(dev));
+
+        return sysfs_emit(buf, "%lld\n", div_s64(imu->wake_latency_ns, NSEC_PER_USEC));
+}
+
+static IIO_DEVICE_ATTR_RO(wake_latency_us, 0);
+
+static struct attribute *my_imu_attributes[] = {
+	&iio_dev_attr_wake_latency_us.dev_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group my_imu_attribute_group = {
+	.attrs = my_imu_attributes,
 };
 
 static const struct iio_info my_imu_info = {
+	.attrs = &my_imu_attribute_group,
 	.read_raw = my_imu_read_raw,
+	.write_raw = my_imu_write_raw,
+	.write_raw_get_fmt = my_imu_write_raw_get_fmt,
+	.read_avail = my_imu_read_avail,
+	.hwfifo_set_watermark = my_imu_set_watermark,
+	.read_event_config = my_imu_read_event_config,
+	.write_event_config = my_imu_write_event_config,
+	.read_event_value = my_imu_read_event_value,
+	.write_event_value = my_imu_write_event_value,
+};
+
+/*
+ * @brief Puts both sensors in power-down while leaving the running configuration in the cache
+ *
+ * Called with imu->lock held, the cache bypass window must not be shared with other writers.
+ */
+static int my_imu_power_down(struct my_imu *imu) {
+        unsigned int id, val;
+        int ret = 0;
+
+        for(id = 0; id < MY_IMU_SENSORS; id++)
+        {
+            //Cache hit, no bus traffic
+            ret = regmap_read(imu->regmap, my_imu_sensors[id].reg, &val);
+            if(ret < 0)
+            {
+                return ret;
+            }
+            regcache_cache_bypass(imu->regmap, true);
+            ret = regmap_write(imu->regmap, my_imu_sensors[id].reg, val & ~my_imu_sensors[id].odr_mask);
+            regcache_cache_bypass(imu->regmap, false);
+            if(ret < 0)
+            {
+                return ret;
+            }
+        }
+        //Config changes while asleep only land in the cache and are applied on resume
+        regcache_cache_only(imu->regmap, true);
+        //The chip may lose every register while asleep, rewrite all of them on the way up
+        regcache_mark_dirty(imu->regmap);
+
+        return 0;
+}
+
+/*
+ * @brief Restores the cached configuration, including the sensor ODRs
+ *
+ * Called with imu->lock held.
+ */
+static int my_imu_power_up(struct my_imu *imu) {
+        imu->snapshot_valid = false;
+        regcache_cache_only(imu->regmap, false);
+        return regcache_sync(imu->regmap);
+}
+
+static int __maybe_unused my_imu_runtime_suspend(struct device *dev) {
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret;
+
+        mutex_lock(&imu->lock);
+        ret = my_imu_power_down(imu);
+        mutex_unlock(&imu->lock);
+
+        return ret;
+}
+
+static int __maybe_unused my_imu_runtime_resume(struct device *dev) {
+	struct iio_dev *indio_dev = dev_get_drvdata(dev);
+	struct my_imu *imu = iio_priv(indio_dev);
+        int ret;
+
+        mutex_lock(&imu->lock);
+        imu->wake_start_ns = ktime_get_ns();
+        ret = my_imu_power_up(imu);
+        mutex_unlock(&imu->lock);
+
+        return ret;
+}
+
+//System sleep reuses the runtime callbacks and leaves an already idle chip alone
+static const struct dev_pm_ops my_imu_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(pm_runtime_force_suspend, pm_runtime_force_resume)
+	SET_RUNTIME_PM_OPS(my_imu_runtime_suspend, my_imu_runtime_resume, NULL)
 };
 
 /* Declate the probe and remove functions */
@@ -237,6 +1716,7 @@ static struct spi_driver my_driver = {
 	.driver = {
 		.name = "myimu",
 		.of_match_table = my_driver_ids,
+		.pm = &my_imu_pm_ops,
 	},
 };
 
@@ -247,95 +1727,162 @@ static int my_imu_probe(struct spi_device *client) {
 	struct iio_dev *indio_dev;
 	struct my_imu *imu;
 	int ret;
-        u8 buffer[2];
+        unsigned int who_am_i;
 
-        pr_info("lsm6ds3_iio: Probe - Device ID: %s\n", spi_get_device_id(client)->name);
+        dev_info(&client->dev, "Probe - Device ID: %s\n", spi_get_device_id(client)->name);
 
-	indio_dev = devm_iio_device_alloc(&client->dev, sizeof(struct iio_dev));
+	indio_dev = devm_iio_device_alloc(&client->dev, sizeof(*imu));
 	if(!indio_dev) {
-		pr_err("lsm6ds3_iio: Error! Out of memory\n");
+		dev_err(&client->dev, "Error! Out of memory\n");
 		return -ENOMEM;
 	}
 
 	imu = iio_priv(indio_dev);
 	imu->client = client;
+	mutex_init(&imu->lock);
+	imu->watermark = 1;
+	//208 Hz, +-2g and 250 dps until userspace asks for something else
+	imu->odr_idx[MY_IMU_ACCEL] = 4;
+	imu->odr_idx[MY_IMU_GYRO] = 4;
+	imu->scale_idx[MY_IMU_ACCEL] = 0;
+	imu->scale_idx[MY_IMU_GYRO] = 1;
+	imu->fifo_buffer = devm_kmalloc(&client->dev, LSM6DS3_FIFO_WORDS * 2, GFP_KERNEL);
+	if(!imu->fifo_buffer) {
+		dev_err(&client->dev, "Error! Out of memory\n");
+		return -ENOMEM;
+	}
 	indio_dev->name = "myimu";
+	//Tells redundant IMUs apart in sysfs, e.g. label = "imu0" in the device tree
+	device_property_read_string(&client->dev, "label", &indio_dev->label);
 	indio_dev->info = &my_imu_info;
 	indio_dev->modes = INDIO_DIRECT_MODE;
 	indio_dev->channels = my_imu_channels;
 	indio_dev->num_channels = ARRAY_SIZE(my_imu_channels);
+	indio_dev->available_scan_masks = my_imu_scan_masks;
         client->max_speed_hz = 10000000;
 	ret = spi_setup(client);
 	if(ret < 0) {
-		pr_err("lsm6ds3_iio: Failed to set up the SPI Bus\n");
+		dev_err(&client->dev, "Failed to set up the SPI Bus\n");
 		return ret;
 	}
+	imu->regmap = devm_regmap_init_spi(client, &my_imu_regmap_config);
+	if(IS_ERR(imu->regmap)) {
+		dev_err(&client->dev, "Failed to set up regmap\n");
+		return PTR_ERR(imu->regmap);
+	}
 
 	/*--------------Initialize lsm6ds3-------------------------------*/
         //Software reset
         //Set in SPI 4-Wire mode
         //Set in little-endian
-        buffer[0] = CTRL3_C | LSM6DS3_SPI_WRITE_STROBE_BM;
-        buffer[1] = CTRL3_C_SW_RESET_BM | CTRL3_C_BLE_LE_BM | CTRL3_C_SIM_4_WIRE_BM;
-        ret = spi_write(client, buffer, 2);
+        ret = regmap_write(imu->regmap, CTRL3_C, CTRL3_C_SW_RESET_BM | CTRL3_C_BLE_LE_BM | CTRL3_C_SIM_4_WIRE_BM);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to wrtie to CTRL3_C");
+            return ret;
+        }
+        usleep_range(100, 200);
+
+        //Keep register auto-increment on so the output registers can be burst read
+        //Block data update so a burst never mixes bytes from two different samples
+        ret = regmap_write(imu->regmap, CTRL3_C, CTRL3_C_BDU_BM | CTRL3_C_IF_INC_BM | CTRL3_C_BLE_LE_BM | CTRL3_C_SIM_4_WIRE_BM);
         if(ret < 0)
         {
-            pr_err("lsm6ds3_iio: Failed to wrtie to CTRL3_C");
+            dev_err(&client->dev, "Failed to wrtie to CTRL3_C");
             return ret;
         }
 
         //use 208 Hz mode (0101)
 	//use +2g mode which is (00) for Scale
 	//use 400 Hz filter (00) for filter
-        buffer[0] = CTRL1_XL | LSM6DS3_SPI_WRITE_STROBE_BM;
-        buffer[1] = CTRL1_XL_208HZ_BM | CTRL1_XL_SCALE_2G_BM | CTRL1_XL_FILTER_400HZ_BM;
-        spi_write(imu->client, buffer, 2);
+        ret = my_imu_write_ctrl(imu, MY_IMU_ACCEL);
         if(ret < 0)
         {
-            pr_err("lsm6ds3_iio: Failed to wrtie to CTRL1_XL");
+            dev_err(&client->dev, "Failed to wrtie to CTRL1_XL");
             return ret;
         }
 
         //we need to enable the x,y, and z access
 	//default (00), Zen, Yen, Xen, Soft_EN, default(00)
 	//X, Y, and Z enabled and soft-iron correction turned off
-        buffer[0] = CTRL9_XL | LSM6DS3_SPI_WRITE_STROBE_BM;
-        buffer[1] = CTRL9_XL_X_EN_BM |CTRL9_XL_Y_EN_BM | CTRL9_XL_Z_EN_BM | CTRL9_XL_SOFT_DIS_BM;
-        spi_write(imu->client, buffer, 2);
+        ret = regmap_write(imu->regmap, CTRL9_XL, CTRL9_XL_X_EN_BM |CTRL9_XL_Y_EN_BM | CTRL9_XL_Z_EN_BM | CTRL9_XL_SOFT_DIS_BM);
         if(ret < 0)
         {
-            pr_err("lsm6ds3_iio: Failed to wrtie to CTRL9_XL");
+            dev_err(&client->dev, "Failed to wrtie to CTRL9_XL");
             return ret;
         }
 
 	//Enable gyroscope at 208HZ and 250DPS
-        buffer[0] = CTRL2_G | LSM6DS3_SPI_WRITE_STROBE_BM;
-        buffer[1] = CTRL2_G_RATE_208HZ_BM | CTRL2_G_250_DPS_BM | CTRL2_G_125_DPS_DIS_BM;
-        spi_write(imu->client, buffer, 2);
+        ret = my_imu_write_ctrl(imu, MY_IMU_GYRO);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to wrtie to CTRL2_G");
+            return ret;
+        }
+
+        //Run the timestamp counter at its 25 us resolution for FIFO sample times
+        ret = regmap_update_bits(imu->regmap, WAKE_UP_DUR, WAKE_UP_DUR_TIMER_HR_BM, WAKE_UP_DUR_TIMER_HR_BM);
+        if(ret < 0)
+        {
+            dev_err(&client->dev, "Failed to wrtie to WAKE_UP_DUR");
+            return ret;
+        }
+        ret = regmap_update_bits(imu->regmap, TAP_CFG, TAP_CFG_TIMER_EN_BM, TAP_CFG_TIMER_EN_BM);
         if(ret < 0)
         {
-            pr_err("lsm6ds3_iio: Failed to wrtie to CTRL2_G");
+            dev_err(&client->dev, "Failed to wrtie to TAP_CFG");
             return ret;
         }
 
         //Read the WHO_AM_I register to ensure proper initialization
-        ret = spi_w8r8(imu->client, WHO_AM_I | LSM6DS3_SPI_READ_STROBE_BM);
-        if(ret != WHO_AM_I_EXPECTED_VALUE)
+        ret = regmap_read(imu->regmap, WHO_AM_I, &who_am_i);
+        if(ret < 0 || who_am_i != WHO_AM_I_EXPECTED_VALUE)
         {
-            pr_err("lsm6ds3_iio: Failed to read WHO_AM_I register");
-            return EIO;
+            dev_err(&client->dev, "Failed to read WHO_AM_I register");
+            return -EIO;
         }
 
+	ret = devm_iio_triggered_buffer_setup(&client->dev, indio_dev, iio_pollfunc_store_time, my_imu_trigger_handler, &my_imu_buffer_ops);
+	if(ret < 0) {
+		dev_err(&client->dev, "Failed to set up the triggered buffer\n");
+		return ret;
+	}
+
+	ret = my_imu_setup_trigger(indio_dev);
+	if(ret < 0) {
+		return ret;
+	}
+
+	ret = my_imu_setup_events(indio_dev);
+	if(ret < 0) {
+		return ret;
+	}
+
 	spi_set_drvdata(client, indio_dev);
 
-	return devm_iio_device_register(&client->dev, indio_dev);
+	//The chip is running, let it power down once nobody has used it for a while
+	pm_runtime_get_noresume(&client->dev);
+	pm_runtime_set_active(&client->dev);
+	pm_runtime_set_autosuspend_delay(&client->dev, LSM6DS3_AUTOSUSPEND_MS);
+	pm_runtime_use_autosuspend(&client->dev);
+	ret = devm_pm_runtime_enable(&client->dev);
+	if(ret < 0) {
+		pm_runtime_put_noidle(&client->dev);
+		return ret;
+	}
+
+	ret = devm_iio_device_register(&client->dev, indio_dev);
+	pm_runtime_mark_last_busy(&client->dev);
+	pm_runtime_put_autosuspend(&client->dev);
+
+	return ret;
 }
 
 /*
  * @brief This function is called on unloading the driver
  */
 static void my_imu_remove(struct spi_device *client) {
-	pr_info("lsm6ds3_iio: Removing device!\n");
+	dev_info(&client->dev, "Removing device!\n");
 }
 
 /* This will create the init and exit function automatically */
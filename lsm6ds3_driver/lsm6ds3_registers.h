@@ -25,11 +25,25 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     FIFO_CTRL3                  = 0x08,
     FIFO_CTRL4                  = 0x09,
     FIFO_CTRL5                  = 0x0A,
+    FIFO_CTRL2_FTH_H_MASK       = 0x0F,
+    FIFO_CTRL2_TIMER_PEDO_EN_BM = 0x80,
+    FIFO_CTRL3_DEC_G_MASK       = 0x38,
+    FIFO_CTRL3_DEC_XL_MASK      = 0x07,
+    FIFO_CTRL4_DEC_DS4_NONE_BM  = 0x08,
+    FIFO_CTRL5_MODE_BYPASS_BM   = 0x00,
+    FIFO_CTRL5_MODE_FIFO_BM     = 0x01,
+    FIFO_CTRL5_MODE_CONT_BM     = 0x06,
 
     ORIENT_CFG_G                = 0x0B,
 
     INT1_CTRL                   = 0x0D,
     INT2_CTRL                   = 0x0E,
+    //INT1_CTRL and INT2_CTRL share these bit positions
+    INT1_CTRL_DRDY_XL_BM        = 0x01,
+    INT1_CTRL_DRDY_G_BM         = 0x02,
+    INT1_CTRL_FTH_BM            = 0x08,
+    INT1_CTRL_FIFO_OVR_BM       = 0x10,
+    INT1_CTRL_STEP_DET_BM       = 0x80,
 
     WHO_AM_I                    = 0x0F,
     WHO_AM_I_EXPECTED_VALUE     = 0x69,
@@ -46,27 +60,44 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     CTRL1_XL_1660HZ_BM          = 0x80,
     CTRL1_XL_3330HZ_BM          = 0x90,
     CTRL1_XL_6660HZ_BM          = 0xA0,
+    CTRL1_XL_ODR_MASK           = 0xF0,
     CTRL1_XL_SCALE_2G_BM        = 0x00,
     CTRL1_XL_SCALE_16G_BM       = 0x04,
     CTRL1_XL_SCALE_4G_BM        = 0x08,
     CTRL1_XL_SCALE_8G_BM        = 0x0C,
+    CTRL1_XL_SCALE_MASK         = 0x0C,
     CTRL1_XL_FILTER_400HZ_BM    = 0x00,
     CTRL1_XL_FILTER_200HZ_BM    = 0x01,
     CTRL1_XL_FILTER_100HZ_BM    = 0x02,
     CTRL1_XL_FILTER_50HZ_BM     = 0x03,
 
     CTRL2_G                     = 0x11,
+    CTRL2_G_POWER_DOWN_BM       = 0x00,
+    CTRL2_G_RATE_12HZ_BM        = 0x10,
+    CTRL2_G_RATE_26HZ_BM        = 0x20,
+    CTRL2_G_RATE_52HZ_BM        = 0x30,
+    CTRL2_G_RATE_104HZ_BM       = 0x40,
     CTRL2_G_RATE_208HZ_BM       = 0x50,
+    CTRL2_G_RATE_416HZ_BM       = 0x60,
+    CTRL2_G_RATE_833HZ_BM       = 0x70,
+    CTRL2_G_RATE_1660HZ_BM      = 0x80,
+    CTRL2_G_ODR_MASK            = 0xF0,
     CTRL2_G_250_DPS_BM          = 0x00,
-    CTRL2_G_125_DPS_EN_BM       = 0x01,
+    CTRL2_G_500_DPS_BM          = 0x04,
+    CTRL2_G_1000_DPS_BM         = 0x08,
+    CTRL2_G_2000_DPS_BM         = 0x0C,
+    CTRL2_G_125_DPS_EN_BM       = 0x02,
     CTRL2_G_125_DPS_DIS_BM      = 0x00,
+    CTRL2_G_FS_MASK             = 0x0E,
 
     CTRL3_C                     = 0x12,
     CTRL3_C_SW_RESET_BM         = 0x01,
     CTRL3_C_BLE_LE_BM           = 0x00,
     CTRL3_C_BLE_BE_BM           = 0x02,
     CTRL3_C_SIM_4_WIRE_BM       = 0x00,
-    CTRL3_C_SIM_3_WIRE_BM       = 0x04,
+    CTRL3_C_SIM_3_WIRE_BM       = 0x08,
+    CTRL3_C_IF_INC_BM           = 0x04,
+    CTRL3_C_BDU_BM              = 0x40,
 
     CTRL4_C                     = 0x13,
     CTRL5_C                     = 0x14,
@@ -84,14 +115,34 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     CTRL9_XL_SOFT_DIS_BM        = 0x00,
 
     CTRL10_C                    = 0x19,
+    CTRL10_C_FUNC_EN_BM         = 0x04,
 
     MASTER_CONFIG               = 0x1A,
 
     WAKE_UP_SRC                 = 0x1B,
+    WAKE_UP_SRC_WU_IA_BM        = 0x08,
+    WAKE_UP_SRC_X_WU_BM         = 0x04,
+    WAKE_UP_SRC_Y_WU_BM         = 0x02,
+    WAKE_UP_SRC_Z_WU_BM         = 0x01,
 
     TAP_SRC                     = 0x1C,
+    TAP_SRC_SINGLE_TAP_BM       = 0x20,
+    TAP_SRC_DOUBLE_TAP_BM       = 0x10,
+    TAP_SRC_X_TAP_BM            = 0x04,
+    TAP_SRC_Y_TAP_BM            = 0x02,
+    TAP_SRC_Z_TAP_BM            = 0x01,
+
     D6D_SRC                     = 0x1D,
+    D6D_SRC_D6D_IA_BM           = 0x40,
+    D6D_SRC_ZH_BM               = 0x20,
+    D6D_SRC_ZL_BM               = 0x10,
+    D6D_SRC_YH_BM               = 0x08,
+    D6D_SRC_YL_BM               = 0x04,
+    D6D_SRC_XH_BM               = 0x02,
+    D6D_SRC_XL_BM               = 0x01,
     STATUS_REG                  = 0x1E,
+    STATUS_REG_XLDA_BM          = 0x01,
+    STATUS_REG_GDA_BM           = 0x02,
 
     OUT_TEMP_L                  = 0x20,
     OUT_TEMP_H                  = 0x21,
@@ -127,6 +178,12 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     FIFO_STATUS2                = 0x3B,
     FIFO_STATUS3                = 0x3C,
     FIFO_STATUS4                = 0x3D,
+    FIFO_STATUS2_WATERM_BM      = 0x80,
+    FIFO_STATUS2_OVER_RUN_BM    = 0x40,
+    FIFO_STATUS2_FULL_BM        = 0x20,
+    FIFO_STATUS2_EMPTY_BM       = 0x10,
+    FIFO_STATUS2_DIFF_H_MASK    = 0x0F,
+    FIFO_STATUS4_PATTERN_H_MASK = 0x03,
 
     FIFO_DATA_OUT_L             = 0x3E,
     FIFO_DATA_OUT_H             = 0x3F,
@@ -134,6 +191,7 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     TIMESTAMP0_REG              = 0x40,
     TIMESTAMP1_REG              = 0x41,
     TIMESTAMP2_REG              = 0x42,
+    TIMESTAMP2_RESET_VAL        = 0xAA,
 
     STEP_TIMESTAMP_L            = 0x49,
     STEP_TIMESTAMP_H            = 0x4A,
@@ -149,19 +207,36 @@ typedef enum LSM6DS3_ACCEL_REGISTERS
     SENSORHUB18_REG             = 0x52,
 
     FUNC_SRC                    = 0x53,
+    FUNC_SRC_STEP_DETECTED_BM   = 0x10,
 
     TAP_CFG                     = 0x58,
+    TAP_CFG_TIMER_EN_BM         = 0x80,
+    TAP_CFG_PEDO_EN_BM          = 0x40,
+    TAP_CFG_TAP_X_EN_BM         = 0x08,
+    TAP_CFG_TAP_Y_EN_BM         = 0x04,
+    TAP_CFG_TAP_Z_EN_BM         = 0x02,
+    TAP_CFG_TAP_EN_MASK         = 0x0E,
+    TAP_CFG_LIR_BM              = 0x01,
     TAP_THS_6D                  = 0x59,
+    TAP_THS_6D_TAP_THS_MASK     = 0x1F,
 
     INT_DUR2                    = 0x5A,
 
     WAKE_UP_THS                 = 0x5B,
+    WAKE_UP_THS_SINGLE_DOUBLE_BM = 0x80,
+    WAKE_UP_THS_WK_THS_MASK     = 0x3F,
     WAKE_UP_DUR                 = 0x5C,
+    WAKE_UP_DUR_TIMER_HR_BM     = 0x10,
 
     FREE_FALL                   = 0x5D,
 
     MD1_CFG                     = 0x5E,
     MD2_CFG                     = 0x5F,
+    //MD1_CFG and MD2_CFG share these bit positions
+    MD2_CFG_SINGLE_TAP_BM       = 0x40,
+    MD2_CFG_WU_BM               = 0x20,
+    MD2_CFG_DOUBLE_TAP_BM       = 0x08,
+    MD2_CFG_6D_BM               = 0x04,
 
     OUT_MAG_RAW_X_L             = 0x66,
     OUT_MAG_RAW_X_H             = 0x67,
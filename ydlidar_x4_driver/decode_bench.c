@@ -0,0 +1,293 @@
+/*
+ * Micro benchmark of the packet decoders in ydlidar_x4_decode.c against the per sample atan() loop userapp used before
+ * and the fixed point ydlidar_decode_points the driver uses, exits with 1 if lidar_decode_packet disagrees with the latter
+ * Usage: ./decode_bench [packets] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ydlidar_x4_decode.h"
+#include "ydlidar_x4_points.h"
+
+#define PI 3.141592654
+//Samples per packet the X4 sends most of the time
+#define BENCH_LSN 40
+#define BENCH_PACKET_SIZE (YDLIDAR_HEADER_SIZE + 2 * BENCH_LSN)
+//LUT and interpolation both round to 1/64 degree, allow one step from each
+#define BENCH_MAX_DIFF_DEG (2.0 / 64)
+
+//Keeps the compiler from dropping decodes whose results are never used
+static volatile float sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * @brief Random packet with realistic distances, 1 in 10 samples invalid (0)
+ */
+static void make_packet(uint8_t *packet)
+{
+    unsigned int fsa = rand() % (360 * 64);
+    unsigned int lsa = (fsa + 64 * 3 + rand() % 256) % (360 * 64);
+    unsigned int d;
+
+    packet[0] = YDLIDAR_PH_LOW;
+    packet[1] = YDLIDAR_PH_HIGH;
+    packet[YDLIDAR_CT_OFFSET] = 0;
+    packet[YDLIDAR_LSN_OFFSET] = BENCH_LSN;
+    packet[YDLIDAR_FSA_OFFSET] = ((fsa << 1) | 1) & 0xFF;
+    packet[YDLIDAR_FSA_OFFSET + 1] = (fsa << 1) >> 8;
+    packet[YDLIDAR_LSA_OFFSET] = ((lsa << 1) | 1) & 0xFF;
+    packet[YDLIDAR_LSA_OFFSET + 1] = (lsa << 1) >> 8;
+    packet[YDLIDAR_CS_OFFSET] = packet[YDLIDAR_CS_OFFSET + 1] = 0;
+    for(int i = 0; i < BENCH_LSN; i++)
+    {
+        //Up to 12 m in 1/4 mm
+        d = rand() % 10 ? 40 + rand() % (12000 * 4) : 0;
+        packet[YDLIDAR_HEADER_SIZE + 2 * i] = d & 0xFF;
+        packet[YDLIDAR_HEADER_SIZE + 1 + 2 * i] = d >> 8;
+    }
+}
+
+static float correction_ref(double distance)
+{
+    if(distance == 0)
+    {
+        return 0;
+    }
+    return atan(21.8 * ((155.3 - distance) / (155.3 * distance))) * 180 / PI;
+}
+
+/*
+ * @brief The decode loop from userapp before it moved to ydlidar_x4_decode.c, interleaved distance/angle output
+ */
+static void legacy_decode(const uint8_t *read_buf, float *send_buffer)
+{
+    int packet_size = (int)read_buf[3];
+    uint16_t raw_value;
+    float distance, diff, fsa, lsa, fsa_correct, lsa_correct, fsa_distance, lsa_distance, angle, angle_correct;
+
+    raw_value = (uint16_t)((read_buf[5] << 8) | read_buf[4]);
+    fsa = (float)(raw_value>>1)/64;
+    raw_value = (uint16_t)((read_buf[7] << 8) | read_buf[6]);
+    lsa = (float)(raw_value>>1)/64;
+    if(lsa < fsa)
+    {
+        lsa += 360;
+    }
+    diff = lsa - fsa;
+    raw_value = (uint16_t)((read_buf[11] << 8) | read_buf[10]);
+    fsa_distance = (float)raw_value / 4;
+    angle_correct = fsa_distance == 0 ? 0 : (atan(21.8 * ((155.3 - fsa_distance)/(155.3*fsa_distance))) * 180) / PI;
+    fsa_correct = fsa + angle_correct;
+    raw_value = (uint16_t)((read_buf[packet_size + 11] << 8) | read_buf[packet_size + 10]);
+    lsa_distance = (float)raw_value / 4;
+    angle_correct = lsa_distance == 0 ? 0 : (atan(21.8 * ((155.3 - lsa_distance)/(155.3*lsa_distance))) * 180) / PI;
+    lsa_correct = lsa + angle_correct;
+    if(fsa_correct > 360)
+    {
+        fsa_correct -= 360;
+    }
+    else if(fsa_correct < 0)
+    {
+        fsa_correct += 360;
+    }
+    memset(send_buffer, 0, 2 * BENCH_LSN * sizeof(float));
+    send_buffer[0] = fsa_distance;
+    send_buffer[1] = fsa_correct;
+    for(int x = 2; x < 2*packet_size - 2; x+=2)
+    {
+        int i = (x/2) + 1;
+        raw_value = (uint16_t)((read_buf[x+11] << 8) | read_buf[x+10]);
+        distance = (float)raw_value / 4;
+        send_buffer[x] = distance;
+        angle_correct = distance == 0 ? 0 : (atan(21.8 * ((155.3 - distance)/(155.3*distance))) * 180) / PI;
+        angle = ((diff/(packet_size-1)) * (i-1)) + fsa + angle_correct;
+        if(angle > 360)
+        {
+            angle -= 360;
+        }
+        else if(angle < 0)
+        {
+            angle += 360;
+        }
+        send_buffer[x+1] = angle;
+    }
+    if(lsa_correct > 360)
+    {
+        lsa_correct -= 360;
+    }
+    else if(lsa_correct < 0)
+    {
+        lsa_correct += 360;
+    }
+    send_buffer[2*packet_size - 2] = lsa_distance;
+    send_buffer[2*packet_size - 1] = lsa_correct;
+}
+
+/*
+ * @brief ydlidar_decode_points with its output converted to mm and degrees
+ */
+static int fixed_decode(const uint8_t *packet, size_t len, float *distance, float *angle)
+{
+    struct ydlidar_point points[LIDAR_DECODE_MAX_POINTS];
+    int count = ydlidar_decode_points(packet, len, points);
+
+    for(int i = 0; i < count; i++)
+    {
+        distance[i] = (float)points[i].distance_q2 / 4;
+        angle[i] = (float)points[i].angle_q6 / 64;
+    }
+    return count;
+}
+
+/*
+ * @brief Largest angle difference between lidar_decode_packet and ydlidar_decode_points, in degrees
+ * @return Negative if the two disagree on the sample count or a distance
+ */
+static double max_diff_fixed(const uint8_t *packets, int count)
+{
+    float distance[LIDAR_DECODE_MAX_POINTS], angle[LIDAR_DECODE_MAX_POINTS];
+    float distance_ref[LIDAR_DECODE_MAX_POINTS], angle_ref[LIDAR_DECODE_MAX_POINTS];
+    double diff, worst = 0;
+
+    for(int p = 0; p < count; p++)
+    {
+        const uint8_t *packet = packets + p * BENCH_PACKET_SIZE;
+
+        if(lidar_decode_packet(packet, BENCH_PACKET_SIZE, distance, angle) != BENCH_LSN ||
+           fixed_decode(packet, BENCH_PACKET_SIZE, distance_ref, angle_ref) != BENCH_LSN)
+        {
+            return -1;
+        }
+        for(int i = 0; i < BENCH_LSN; i++)
+        {
+            if(distance[i] != distance_ref[i])
+            {
+                return -1;
+            }
+            diff = fabs(remainder(angle[i] - angle_ref[i], 360));
+            if(diff > worst)
+            {
+                worst = diff;
+            }
+        }
+    }
+    return worst;
+}
+
+/*
+ * @brief Largest angle error of a decoder against double precision atan(), in degrees
+ */
+static double max_error(int (*decode)(const uint8_t *, size_t, float *, float *), const uint8_t *packets, int count)
+{
+    float distance[LIDAR_DECODE_MAX_POINTS], angle[LIDAR_DECODE_MAX_POINTS];
+    double err, worst = 0, fsa, lsa, ref;
+
+    for(int p = 0; p < count; p++)
+    {
+        const uint8_t *packet = packets + p * BENCH_PACKET_SIZE;
+
+        decode(packet, BENCH_PACKET_SIZE, distance, angle);
+        fsa = (double)((packet[YDLIDAR_FSA_OFFSET] | (packet[YDLIDAR_FSA_OFFSET + 1] << 8)) >> 1) / 64;
+        lsa = (double)((packet[YDLIDAR_LSA_OFFSET] | (packet[YDLIDAR_LSA_OFFSET + 1] << 8)) >> 1) / 64;
+        if(lsa < fsa)
+        {
+            lsa += 360;
+        }
+        for(int i = 0; i < BENCH_LSN; i++)
+        {
+            ref = fsa + (lsa - fsa) / (BENCH_LSN - 1) * i + correction_ref(distance[i]);
+            err = fabs(remainder(angle[i] - ref, 360));
+            if(err > worst)
+            {
+                worst = err;
+            }
+        }
+    }
+    return worst;
+}
+
+static double bench(int (*decode)(const uint8_t *, size_t, float *, float *), const uint8_t *packets, int count, int rounds)
+{
+    float distance[LIDAR_DECODE_MAX_POINTS], angle[LIDAR_DECODE_MAX_POINTS];
+    double start = now_ns();
+
+    for(int r = 0; r < rounds; r++)
+    {
+        for(int p = 0; p < count; p++)
+        {
+            decode(packets + p * BENCH_PACKET_SIZE, BENCH_PACKET_SIZE, distance, angle);
+            sink = angle[BENCH_LSN - 1];
+        }
+    }
+    return (now_ns() - start) / ((double)count * rounds);
+}
+
+static double bench_legacy(const uint8_t *packets, int count, int rounds)
+{
+    float send_buffer[2 * BENCH_LSN];
+    double start = now_ns();
+
+    for(int r = 0; r < rounds; r++)
+    {
+        for(int p = 0; p < count; p++)
+        {
+            legacy_decode(packets + p * BENCH_PACKET_SIZE, send_buffer);
+            sink = send_buffer[2 * BENCH_LSN - 1];
+        }
+    }
+    return (now_ns() - start) / ((double)count * rounds);
+}
+
+int main(int argc, char *argv[])
+{
+    int count = argc > 1 ? atoi(argv[1]) : 4096;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    uint8_t *packets;
+    double legacy, fixed, fast, diff;
+
+    if(count <= 0 || rounds <= 0)
+    {
+        printf("Usage: %s [packets] [rounds]\n", argv[0]);
+        return 1;
+    }
+    packets = malloc((size_t)count * BENCH_PACKET_SIZE);
+    if(!packets)
+    {
+        perror("malloc failed");
+        return 1;
+    }
+    srand(1);
+    for(int p = 0; p < count; p++)
+    {
+        make_packet(packets + p * BENCH_PACKET_SIZE);
+    }
+    legacy = bench_legacy(packets, count, rounds);
+    fixed = bench(fixed_decode, packets, count, rounds);
+    fast = bench(lidar_decode_packet, packets, count, rounds);
+    printf("%d packets of %d samples, %d rounds\n", count, BENCH_LSN, rounds);
+    printf("%-8s %8.1f ns/packet %6.2f ns/sample\n", "legacy", legacy, legacy / BENCH_LSN);
+    printf("%-8s %8.1f ns/packet %6.2f ns/sample %5.1fx  max error %.5f deg\n", "fixed", fixed, fixed / BENCH_LSN,
+           legacy / fixed, max_error(fixed_decode, packets, count));
+    printf("%-8s %8.1f ns/packet %6.2f ns/sample %5.1fx  max error %.5f deg\n", lidar_decode_impl(), fast, fast / BENCH_LSN,
+           legacy / fast, max_error(lidar_decode_packet, packets, count));
+    diff = max_diff_fixed(packets, count);
+    free(packets);
+    if(diff < 0 || diff > BENCH_MAX_DIFF_DEG)
+    {
+        printf("%s disagrees with ydlidar_decode_points (max difference %.5f deg)\n", lidar_decode_impl(), diff);
+        return 1;
+    }
+    printf("%s matches ydlidar_decode_points within %.5f deg\n", lidar_decode_impl(), diff);
+    return 0;
+}
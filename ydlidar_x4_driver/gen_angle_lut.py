@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# Generates ydlidar_x4_lut.h, the X4 angle correction lookup table used by ydlidar_x4_points.h
+#
+# The X4 datasheet gives the correction for a sample at distance d (mm) as
+#   AngCorrect = atan(21.8 * (155.3 - d) / (155.3 * d))   (degrees, 0 when d == 0)
+# It changes quickly close to the sensor and slowly far away, so the table is indexed
+# by the raw q2 distance (1/4 mm) in three tiers of decreasing resolution:
+#   tier 0: raw q2 [0, 1024)          step 1/4 mm
+#   tier 1: mm     [256, 2048)        step 1 mm
+#   tier 2: mm     [2048, 16384)      step 16 mm
+# Worst case lookup error is under 1 LSB of the q6 (1/64 degree) output.
+#
+# Usage: python3 gen_angle_lut.py > ydlidar_x4_lut.h
+
+import math
+
+TIER0_END_Q2 = 1024
+TIER1_END_MM = 2048
+TIER2_STEP_MM = 16
+MAX_MM = 16384
+
+
+def correct_q6(d_mm):
+    if d_mm == 0:
+        return 0
+    deg = math.degrees(math.atan(21.8 * (155.3 - d_mm) / (155.3 * d_mm)))
+    return int(round(deg * 64))
+
+
+def main():
+    table = []
+    for q2 in range(TIER0_END_Q2):
+        table.append(correct_q6(q2 / 4.0))
+    # Sample the middle of each bucket of q2 values so truncating the index rounds to nearest
+    for mm in range(TIER0_END_Q2 // 4, TIER1_END_MM):
+        table.append(correct_q6(mm + 0.375))
+    for mm in range(TIER1_END_MM, MAX_MM, TIER2_STEP_MM):
+        table.append(correct_q6(mm + (TIER2_STEP_MM - 0.25) / 2.0))
+
+    tier1_base = TIER0_END_Q2
+    tier2_base = tier1_base + (TIER1_END_MM - TIER0_END_Q2 // 4)
+
+    print("/* Generated by gen_angle_lut.py, do not edit */")
+    print("#ifndef YDLIDAR_X4_LUT_H")
+    print("#define YDLIDAR_X4_LUT_H")
+    print()
+    print("#define YDLIDAR_LUT_TIER0_END_Q2 %d" % TIER0_END_Q2)
+    print("#define YDLIDAR_LUT_TIER1_END_MM %d" % TIER1_END_MM)
+    print("#define YDLIDAR_LUT_TIER2_SHIFT %d" % int(math.log2(TIER2_STEP_MM)))
+    print("#define YDLIDAR_LUT_TIER1_BASE %d" % tier1_base)
+    print("#define YDLIDAR_LUT_TIER2_BASE %d" % tier2_base)
+    print("#define YDLIDAR_LUT_SIZE %d" % len(table))
+    print()
+    print("//Angle correction in 1/64 degree")
+    print("static const __s16 ydlidar_angle_correct_lut[YDLIDAR_LUT_SIZE] = {")
+    for i in range(0, len(table), 12):
+        print("\t" + " ".join("%d," % v for v in table[i:i + 12]))
+    print("};")
+    print()
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()
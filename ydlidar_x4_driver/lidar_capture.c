@@ -0,0 +1,504 @@
+/*
+ * Records raw YDLIDAR X4 packets and LSM6DS3 samples into a capture log (ydlidar_x4_capture.h)
+ * Replay a log with userapp --replay, or summarize it with lidar_capture --info
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ydlidar_x4.h"
+#include "ydlidar_x4_capture.h"
+
+#define DEVICE "/dev/my_uart_driver"
+#define IIO_SYSFS "/sys/bus/iio/devices/iio:device%d"
+//Big enough that the SD card sees few large writes
+#define WRITE_BUFFER_SIZE (1 << 20)
+//Buffered records reach the file at least this often, so a crash loses little
+#define FLUSH_INTERVAL_NS 1000000000ULL
+//poll timeout, and the pause between polls while someone else has stopped the scan
+#define POLL_MS 200
+//LSM6DS3 scan: 6 16 bit channels padded to 16 bytes, then the 64 bit timestamp
+#define IMU_SCAN_SIZE 24
+#define IMU_TIMESTAMP_OFFSET 16
+#define IMU_READ_SCANS 64
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
+{
+    running = 0;
+}
+
+static uint64_t clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * @return 0, or -1 if the attribute could not be written
+ */
+static int sysfs_write(int iio, const char *attr, const char *value)
+{
+    char path[256];
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path), IIO_SYSFS "/%s", iio, attr);
+    f = fopen(path, "w");
+    if(!f)
+    {
+        perror(path);
+        return -1;
+    }
+    ret = fputs(value, f) < 0 ? -1 : 0;
+    if(fclose(f))
+    {
+        ret = -1;
+    }
+    if(ret)
+    {
+        fprintf(stderr, "Could not write %s to %s\n", value, path);
+    }
+    return ret;
+}
+
+static int sysfs_read(int iio, const char *attr, char *value, size_t size)
+{
+    char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), IIO_SYSFS "/%s", iio, attr);
+    f = fopen(path, "r");
+    if(!f || !fgets(value, size, f))
+    {
+        if(f)
+        {
+            fclose(f);
+        }
+        return -1;
+    }
+    fclose(f);
+    value[strcspn(value, "\n")] = 0;
+    return 0;
+}
+
+static uint32_t scale_nano(int iio, const char *attr)
+{
+    char value[64];
+
+    if(sysfs_read(iio, attr, value, sizeof(value)))
+    {
+        return 0;
+    }
+    return (uint32_t)(strtod(value, NULL) * 1e9 + 0.5);
+}
+
+/*
+ * @brief Enable every scan element, timestamp the samples with CLOCK_BOOTTIME like the lidar, and start the buffer
+ * @return File descriptor of the IIO character device, or -1
+ */
+static int imu_start(int iio)
+{
+    char path[320], name[64], trigger[80];
+    struct dirent *entry;
+    size_t len;
+    DIR *dir;
+    int fd;
+
+    sysfs_write(iio, "buffer/enable", "0");
+    if(sysfs_write(iio, "current_timestamp_clock", "boottime"))
+    {
+        return -1;
+    }
+    //All 6 axes and the timestamp, IMU_SCAN_SIZE assumes every element is on
+    snprintf(path, sizeof(path), IIO_SYSFS "/scan_elements", iio);
+    dir = opendir(path);
+    if(!dir)
+    {
+        perror(path);
+        return -1;
+    }
+    while((entry = readdir(dir)))
+    {
+        len = strlen(entry->d_name);
+        if(len < 3 || strcmp(entry->d_name + len - 3, "_en"))
+        {
+            continue;
+        }
+        snprintf(path, sizeof(path), "scan_elements/%s", entry->d_name);
+        if(sysfs_write(iio, path, "1"))
+        {
+            closedir(dir);
+            return -1;
+        }
+    }
+    closedir(dir);
+    //The driver registers its data ready trigger as <name>-dev<N>
+    if(!sysfs_read(iio, "name", name, sizeof(name)))
+    {
+        snprintf(trigger, sizeof(trigger), "%s-dev%d", name, iio);
+        sysfs_write(iio, "trigger/current_trigger", trigger);
+    }
+    if(sysfs_write(iio, "buffer/enable", "1"))
+    {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "/dev/iio:device%d", iio);
+    fd = open(path, O_RDONLY | O_NONBLOCK);
+    if(fd < 0)
+    {
+        perror(path);
+        sysfs_write(iio, "buffer/enable", "0");
+    }
+    return fd;
+}
+
+static int write_record(FILE *out, uint16_t type, uint64_t timestamp_ns, uint32_t aux, const void *payload, uint32_t length)
+{
+    static const unsigned char padding[CAPTURE_ALIGN];
+    struct capture_record rec;
+    size_t pad = capture_record_size(length) - sizeof(rec) - length;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = type;
+    rec.length = length;
+    rec.timestamp_ns = timestamp_ns;
+    rec.aux = aux;
+    if(fwrite(&rec, sizeof(rec), 1, out) != 1 || fwrite(payload, 1, length, out) != length ||
+       fwrite(padding, 1, pad, out) != pad)
+    {
+        perror("Write failed");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @return Number of lidar packets written, or -1
+ */
+static int capture_lidar(int fd, FILE *out)
+{
+    unsigned char buf[sizeof(struct ydlidar_packet_header) + YDLIDAR_MAX_PACKET_SIZE];
+    struct ydlidar_packet_header *hdr = (struct ydlidar_packet_header *)buf;
+    int packets = 0;
+    ssize_t ret;
+
+    //Drain everything queued so the driver's ring never fills behind a slow IMU read
+    while((ret = read(fd, buf, sizeof(buf))) > 0)
+    {
+        if(write_record(out, CAPTURE_RECORD_LIDAR, hdr->timestamp_ns, hdr->sample_period_ns,
+                        buf + sizeof(*hdr), hdr->length))
+        {
+            return -1;
+        }
+        packets++;
+    }
+    //EINVAL while someone else has stopped the scan, keep capturing the IMU until it is restarted
+    if(ret < 0 && errno != EAGAIN && errno != EINTR && errno != EINVAL)
+    {
+        perror("Lidar read failed");
+        return -1;
+    }
+    return packets;
+}
+
+static int capture_imu(int fd, FILE *out)
+{
+    unsigned char buf[IMU_READ_SCANS * IMU_SCAN_SIZE];
+    struct capture_imu_sample sample;
+    int64_t timestamp_ns;
+    int samples = 0;
+    ssize_t ret;
+
+    while((ret = read(fd, buf, sizeof(buf))) > 0)
+    {
+        for(ssize_t off = 0; off + IMU_SCAN_SIZE <= ret; off += IMU_SCAN_SIZE)
+        {
+            memcpy(&sample, buf + off, sizeof(sample));
+            memcpy(&timestamp_ns, buf + off + IMU_TIMESTAMP_OFFSET, sizeof(timestamp_ns));
+            if(write_record(out, CAPTURE_RECORD_IMU, timestamp_ns, 0, &sample, sizeof(sample)))
+            {
+                return -1;
+            }
+            samples++;
+        }
+    }
+    if(ret < 0 && errno != EAGAIN && errno != EINTR)
+    {
+        perror("IMU read failed");
+        return -1;
+    }
+    return samples;
+}
+
+static int capture(const char *path, const char *device, int iio, int seconds)
+{
+    struct capture_file_header hdr;
+    struct pollfd pfd[2];
+    uint64_t start, last_flush, now;
+    uint64_t packets = 0, samples = 0;
+    int nfds = 1, ret = 0, n;
+    struct sigaction sa;
+    FILE *out;
+
+    pfd[0].fd = open(device, O_RDWR | O_NONBLOCK);
+    if(pfd[0].fd < 0)
+    {
+        perror(device);
+        return -1;
+    }
+    pfd[0].events = POLLIN;
+    if(iio >= 0)
+    {
+        pfd[1].fd = imu_start(iio);
+        if(pfd[1].fd < 0)
+        {
+            close(pfd[0].fd);
+            return -1;
+        }
+        pfd[1].events = POLLIN;
+        nfds = 2;
+    }
+    //Never append to or overwrite an existing capture
+    out = fopen(path, "wxb");
+    if(!out)
+    {
+        perror(path);
+        ret = -1;
+        goto close_fds;
+    }
+    setvbuf(out, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, CAPTURE_MAGIC, sizeof(hdr.magic));
+    hdr.version = CAPTURE_VERSION;
+    hdr.header_size = sizeof(hdr);
+    hdr.start_boottime_ns = clock_ns(CLOCK_BOOTTIME);
+    hdr.start_realtime_ns = clock_ns(CLOCK_REALTIME);
+    if(iio >= 0)
+    {
+        hdr.accel_scale_nano = scale_nano(iio, "in_incli_scale");
+        hdr.gyro_scale_nano = scale_nano(iio, "in_anglvel_scale");
+    }
+    if(fwrite(&hdr, sizeof(hdr), 1, out) != 1)
+    {
+        perror("Write failed");
+        ret = -1;
+        goto close_out;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    ioctl(pfd[0].fd, SET_READ_FORMAT, YDLIDAR_FMT_PACKET_TS);
+    if(ioctl(pfd[0].fd, SEND_START_COMMAND, 0) < 0)
+    {
+        perror("Could not start scanning");
+        ret = -1;
+        goto close_out;
+    }
+
+    start = last_flush = clock_ns(CLOCK_MONOTONIC);
+    while(running)
+    {
+        if(poll(pfd, nfds, POLL_MS) < 0 && errno != EINTR)
+        {
+            perror("poll failed");
+            ret = -1;
+            break;
+        }
+        //POLLERR alone only means the lidar is not scanning
+        if(pfd[0].revents & POLLHUP)
+        {
+            fprintf(stderr, "Lidar device was removed\n");
+            break;
+        }
+        n = capture_lidar(pfd[0].fd, out);
+        if(n < 0)
+        {
+            ret = -1;
+            break;
+        }
+        packets += n;
+        if(nfds == 2)
+        {
+            n = capture_imu(pfd[1].fd, out);
+            if(n < 0)
+            {
+                ret = -1;
+                break;
+            }
+            samples += n;
+        }
+        now = clock_ns(CLOCK_MONOTONIC);
+        if(now - last_flush >= FLUSH_INTERVAL_NS)
+        {
+            fflush(out);
+            last_flush = now;
+        }
+        if(seconds > 0 && now - start >= (uint64_t)seconds * 1000000000ULL)
+        {
+            break;
+        }
+        if(pfd[0].revents & POLLERR)
+        {
+            //poll returns at once until the scan is restarted
+            usleep(POLL_MS * 1000);
+        }
+    }
+    ioctl(pfd[0].fd, SEND_STOP_COMMAND, 0);
+    printf("Captured %" PRIu64 " lidar packets and %" PRIu64 " IMU samples to %s\n", packets, samples, path);
+
+close_out:
+    if(fclose(out))
+    {
+        perror("Write failed");
+        ret = -1;
+    }
+close_fds:
+    if(nfds == 2)
+    {
+        close(pfd[1].fd);
+        sysfs_write(iio, "buffer/enable", "0");
+    }
+    close(pfd[0].fd);
+    return ret;
+}
+
+/*
+ * @brief Print what a capture log holds
+ */
+static int info(const char *path)
+{
+    const struct capture_file_header *hdr;
+    const struct capture_record *rec;
+    uint64_t count[3] = {0}, first = 0, last = 0;
+    size_t offset, size;
+    unsigned char *base;
+    struct stat st;
+    double seconds;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &st))
+    {
+        perror(path);
+        return -1;
+    }
+    size = st.st_size;
+    base = size ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(base == MAP_FAILED || !(offset = capture_first(base, size)))
+    {
+        fprintf(stderr, "%s is not a capture log\n", path);
+        if(base != MAP_FAILED)
+        {
+            munmap(base, size);
+        }
+        return -1;
+    }
+    hdr = (const struct capture_file_header *)base;
+    while((rec = capture_next(base, size, &offset)))
+    {
+        if(!first)
+        {
+            first = rec->timestamp_ns;
+        }
+        last = rec->timestamp_ns;
+        count[rec->type < 3 ? rec->type : 0]++;
+    }
+    seconds = last > first ? (last - first) / 1e9 : 0;
+    printf("%s: version %u, %.1f s\n", path, hdr->version, seconds);
+    printf("  lidar packets %" PRIu64 " (%.1f/s)\n", count[CAPTURE_RECORD_LIDAR], seconds ? count[CAPTURE_RECORD_LIDAR] / seconds : 0);
+    printf("  IMU samples %" PRIu64 " (%.1f/s), accel scale %u ng, gyro scale %u ndps\n", count[CAPTURE_RECORD_IMU],
+           seconds ? count[CAPTURE_RECORD_IMU] / seconds : 0, hdr->accel_scale_nano, hdr->gyro_scale_nano);
+    if(count[0])
+    {
+        printf("  unknown records %" PRIu64 "\n", count[0]);
+    }
+    if(offset != size)
+    {
+        printf("  %zu bytes of torn record at the end\n", size - offset);
+    }
+    munmap(base, size);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s -o FILE [-d DEVICE] [-I N] [-t SECONDS]\n"
+           "       %s --info FILE\n"
+           "  -o, --output FILE     capture log to create, never overwritten\n"
+           "  -d, --device PATH     lidar character device (default " DEVICE ")\n"
+           "  -I, --iio N           also record the IMU at /dev/iio:deviceN\n"
+           "  -t, --time SECONDS    stop after SECONDS, default is until interrupted\n"
+           "      --info FILE       summarize a capture log\n",
+           name, name);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct option long_options[] = {
+        {"output", required_argument, NULL, 'o'},
+        {"device", required_argument, NULL, 'd'},
+        {"iio", required_argument, NULL, 'I'},
+        {"time", required_argument, NULL, 't'},
+        {"info", required_argument, NULL, 'n'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+    const char *output = NULL, *device = DEVICE;
+    int iio = -1, seconds = 0, opt;
+
+    while((opt = getopt_long(argc, argv, "o:d:I:t:h", long_options, NULL)) != -1)
+    {
+        switch(opt)
+        {
+            case 'o':
+                output = optarg;
+                break;
+            case 'd':
+                device = optarg;
+                break;
+            case 'I':
+                iio = atoi(optarg);
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                break;
+            case 'n':
+                return info(optarg) ? EXIT_FAILURE : 0;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if(!output)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return capture(output, device, iio, seconds) ? EXIT_FAILURE : 0;
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <linux/ioctl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
@@ -10,68 +11,664 @@
 #include <stdint.h>
 #include <math.h>
 #include <stdbool.h>
+#include <endian.h>
+#include <inttypes.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 
 #include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+//termios2, a serial port at the X4's 128000 baud needs BOTHER
+#include <asm/termbits.h>
+
+#include "ydlidar_x4.h"
+#include "ydlidar_x4_udp.h"
+#include "ydlidar_x4_decode.h"
+#include "ydlidar_x4_queue.h"
+#include "ydlidar_x4_capture.h"
+#include "ydlidar_x4_parser.h"
 
 #define SERVER_IP "192.168.1.6"
 #define SERVER_PORT 6969
-#define ARRAY_SIZE 80
-
-#define PI 3.141592654
+//Datagrams handed to the kernel per sendmmsg call, a revolution is ~100 packets
+#define SEND_BATCH 16
 
 #define DEVICE "/dev/my_uart_driver"
+//Default slots in each pipeline queue, ~1.5 s of packets
+#define QUEUE_SLOTS 1024
+//Longest a pipeline thread sleeps before checking for shutdown
+#define WAIT_MS 200
+//Longest a partial batch waits for more packets
+#define FLUSH_MS 20
+#define STATS_INTERVAL 5
+//Bytes taken from a serial port per read, ~40 ms of X4 output
+#define TTY_READ_SIZE 512
+//Nominal 5 kHz X4 sample period, reading a serial port directly does not measure it
+#define TTY_SAMPLE_PERIOD_NS 200000
+
+static const unsigned char tty_start_command[2] = {YDLIDAR_CMD_SYNC, YDLIDAR_CMD_START_SCAN};
+static const unsigned char tty_stop_command[2] = {YDLIDAR_CMD_SYNC, YDLIDAR_CMD_STOP_SCAN};
+
+/*
+ * @brief Datagrams waiting to be sent with a single sendmmsg call
+ */
+struct udp_batch {
+    int sockfd;
+    struct sockaddr_in *addr;
+    uint32_t seq;
+    unsigned int count;
+    //Datagrams sent and sendmmsg calls made, read by the stats loop
+    _Atomic uint64_t sent;
+    _Atomic uint64_t calls;
+    unsigned char data[SEND_BATCH][YDLIDAR_UDP_MAX_DATAGRAM];
+    struct iovec iov[SEND_BATCH];
+    struct mmsghdr msgs[SEND_BATCH];
+};
+
+/*
+ * @brief Send every queued datagram
+ */
+static void udp_batch_flush(struct udp_batch *batch)
+{
+    unsigned int sent = 0;
+    int ret;
+
+    while(sent < batch->count)
+    {
+        ret = sendmmsg(batch->sockfd, batch->msgs + sent, batch->count - sent, 0);
+        atomic_fetch_add_explicit(&batch->calls, 1, memory_order_relaxed);
+        if(ret < 0)
+        {
+            //UDP is best effort, drop the rest of the batch rather than stall the reader
+            perror("sendmmsg failed");
+            break;
+        }
+        sent += ret;
+    }
+    atomic_fetch_add_explicit(&batch->sent, sent, memory_order_relaxed);
+    batch->count = 0;
+}
 
-#define START_IOC_MAGIC 'Z'
-#define SEND_START_COMMAND _IOW(START_IOC_MAGIC, 1, unsigned long)
+/*
+ * @brief Encode one decoded lidar packet as a datagram, sending the batch once it is full or a revolution completes
+ * @param distance Distances in mm
+ * @param angle Angles in degrees
+ */
+static void udp_batch_add(struct udp_batch *batch, const float *distance, const float *angle, int count, uint64_t timestamp_ns, bool start_of_scan)
+{
+    struct ydlidar_udp_header hdr;
+    struct ydlidar_udp_point point;
+    unsigned char *out;
+    int angle_q6;
+
+    //A new revolution pushes out the previous one so the GUI never waits on a half filled batch
+    if(start_of_scan && batch->count)
+    {
+        udp_batch_flush(batch);
+    }
+    out = batch->data[batch->count];
+    hdr.magic = htole32(YDLIDAR_UDP_MAGIC);
+    hdr.version = YDLIDAR_UDP_VERSION;
+    hdr.flags = start_of_scan ? YDLIDAR_UDP_START_OF_SCAN : 0;
+    hdr.count = htole16(count);
+    hdr.seq = htole32(batch->seq++);
+    hdr.timestamp_ns = htole64(timestamp_ns);
+    memcpy(out, &hdr, sizeof(hdr));
+    out += sizeof(hdr);
+    for(int i = 0; i < count; i++)
+    {
+        angle_q6 = (int)lroundf(angle[i] * 64) % (360 * 64);
+        if(angle_q6 < 0)
+        {
+            angle_q6 += 360 * 64;
+        }
+        point.distance_q2 = htole16((uint16_t)lroundf(distance[i] * 4));
+        point.angle_q6 = htole16((int16_t)angle_q6);
+        memcpy(out, &point, sizeof(point));
+        out += sizeof(point);
+    }
+    batch->iov[batch->count].iov_base = batch->data[batch->count];
+    batch->iov[batch->count].iov_len = out - batch->data[batch->count];
+    memset(&batch->msgs[batch->count], 0, sizeof(batch->msgs[0]));
+    batch->msgs[batch->count].msg_hdr.msg_name = batch->addr;
+    batch->msgs[batch->count].msg_hdr.msg_namelen = sizeof(*batch->addr);
+    batch->msgs[batch->count].msg_hdr.msg_iov = &batch->iov[batch->count];
+    batch->msgs[batch->count].msg_hdr.msg_iovlen = 1;
+    if(++batch->count == SEND_BATCH)
+    {
+        udp_batch_flush(batch);
+    }
+}
 
-#define STOP_IOC_MAGIC 'Y'
-#define SEND_STOP_COMMAND _IOW(STOP_IOC_MAGIC, 1, unsigned long)
 
-#define INFO_IOC_MAGIC 'X'
-#define SEND_INFO_COMMAND _IOW(INFO_IOC_MAGIC, 1, unsigned long)
+struct options {
+    const char *device;
+    const char *server;
+    int port;
+    bool interactive;
+    int stats_interval;
+    int queue_slots;
+    //Capture log to read instead of the device, NULL for live data
+    const char *replay;
+    //Replay rate relative to the capture, 0 for as fast as the pipeline goes
+    double speed;
+    //Serial port with an X4 (or x4_emulator) to parse directly instead of going through the driver, NULL for the device
+    const char *tty;
+};
+
+//Raw packet as returned by the driver in YDLIDAR_FMT_PACKET_TS
+struct raw_slot {
+    struct ydlidar_packet_header header;
+    unsigned char packet[YDLIDAR_MAX_PACKET_SIZE];
+};
+
+struct points_slot {
+    uint64_t timestamp_ns;
+    int count;
+    bool start_of_scan;
+    float distance[LIDAR_DECODE_MAX_POINTS];
+    float angle[LIDAR_DECODE_MAX_POINTS];
+};
+
+/*
+ * @brief Reader -> decoder -> sender threads, each pair connected by a lock free queue
+ * A full queue drops the packet instead of blocking, so a slow network never stalls the device read
+ */
+struct pipeline {
+    int fd;
+    struct udp_batch *batch;
+    struct spsc_queue raw;
+    struct spsc_queue points;
+    //Each counter is written by one thread and read by the stats loop
+    _Atomic uint64_t packets_read;
+    _Atomic uint64_t read_drops;
+    _Atomic uint64_t packets_decoded;
+    _Atomic uint64_t decode_errors;
+    _Atomic uint64_t decode_drops;
+    //Mapped capture log when replaying
+    const unsigned char *replay;
+    size_t replay_size;
+    double speed;
+    //Wait for queue space instead of dropping, only when nothing upstream can overflow (flat out replay)
+    bool lossless;
+    //fd is a serial port, framed by the driver's parser in user space
+    bool tty;
+    struct ydlidar_parser parser;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
+{
+    running = 0;
+}
 
-#define STATUS_IOC_MAGIC 'W'
-#define SEND_STATUS_COMMAND _IOW(STATUS_IOC_MAGIC, 1, unsigned long)
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
 
-#define REBOOT_IOC_MAGIC 'V'
-#define SEND_REBOOT_COMMAND _IOW(REBOOT_IOC_MAGIC, 1, unsigned long)
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-#define MODE_IOC_MAGIC 'U'
-#define CURRENT_MODE _IOW(MODE_IOC_MAGIC, 1, unsigned long)
+static uint64_t boottime_ns(void)
+{
+    struct timespec ts;
 
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
-int main(int argc, char *argv[]) {
+static void count(_Atomic uint64_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
 
+static void *reader_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    struct pollfd pfd = {p->fd, POLLIN, 0};
+    struct raw_slot scratch, *slot;
+    ssize_t ret;
+
+    while(running)
+    {
+        ret = poll(&pfd, 1, WAIT_MS);
+        if(ret <= 0)
+        {
+            continue;
+        }
+        //POLLERR alone only means the lidar is not scanning, the read below reports it
+        if(pfd.revents & POLLHUP)
+        {
+            fprintf(stderr, "Lidar device was removed\n");
+            running = 0;
+            break;
+        }
+        //Packets still have to be drained from the driver when the decoder is behind
+        slot = spsc_reserve(&p->raw);
+        ret = read(p->fd, slot ? slot : &scratch, sizeof(scratch));
+        if(ret <= 0)
+        {
+            if(errno == EINVAL)
+            {
+                //Someone else stopped the scan, wait for it to be restarted
+                fprintf(stderr, "Lidar is not in scan mode\n");
+                usleep(WAIT_MS * 1000);
+            }
+            else if(errno != EAGAIN && errno != EINTR)
+            {
+                perror("Read failed");
+                running = 0;
+            }
+            continue;
+        }
+        if(!slot)
+        {
+            count(&p->read_drops);
+            continue;
+        }
+        spsc_publish(&p->raw);
+        count(&p->packets_read);
+    }
+    return NULL;
+}
 
+/*
+ * @brief Stands in for the reader, feeding the lidar packets of a capture log at speed times their original rate
+ */
+static void *replay_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    const struct capture_record *rec;
+    struct raw_slot *slot;
+    size_t offset = capture_first(p->replay, p->replay_size);
+    uint64_t first = 0, start = monotonic_ns(), due, now;
+
+    while(running && (rec = capture_next(p->replay, p->replay_size, &offset)))
+    {
+        if(rec->type != CAPTURE_RECORD_LIDAR || rec->length > YDLIDAR_MAX_PACKET_SIZE)
+        {
+            continue;
+        }
+        if(!first)
+        {
+            first = rec->timestamp_ns;
+        }
+        if(p->speed > 0)
+        {
+            due = start + (uint64_t)((rec->timestamp_ns - first) / p->speed);
+            while(running && (now = monotonic_ns()) < due)
+            {
+                usleep(due - now > WAIT_MS * 1000000ULL ? WAIT_MS * 1000 : (due - now) / 1000);
+            }
+        }
+        //Paced replay drops like the device would, flat out replay waits so every packet is measured
+        while(!(slot = spsc_reserve(&p->raw)) && p->lossless && running)
+        {
+            usleep(100);
+        }
+        if(!slot)
+        {
+            count(&p->read_drops);
+            continue;
+        }
+        slot->header.timestamp_ns = rec->timestamp_ns;
+        slot->header.sample_period_ns = rec->aux;
+        slot->header.length = rec->length;
+        memcpy(slot->packet, rec + 1, rec->length);
+        spsc_publish(&p->raw);
+        count(&p->packets_read);
+    }
+    //Let the decoder and sender finish what was replayed, then shut down
+    while(running && (spsc_depth(&p->raw) || spsc_depth(&p->points)))
+    {
+        usleep(1000);
+    }
+    running = 0;
+    return NULL;
+}
 
+/*
+ * @brief Stands in for the reader on a serial port, framing packets with the same parser the driver runs
+ */
+static void *tty_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    struct ydlidar_parser *parser = &p->parser;
+    struct pollfd pfd = {p->fd, POLLIN, 0};
+    unsigned char buf[TTY_READ_SIZE];
+    struct raw_slot *slot;
+    size_t offset, consumed;
+    uint64_t now;
+    ssize_t ret;
+
+    //Collect the scan start reply, once packets flow A5 5A are just sample bytes
+    parser->resp_type = YDLIDAR_RESP_TYPE_SCAN;
+    while(running)
+    {
+        ret = poll(&pfd, 1, WAIT_MS);
+        if(ret <= 0)
+        {
+            continue;
+        }
+        if(pfd.revents & (POLLHUP | POLLERR))
+        {
+            fprintf(stderr, "Serial port was closed\n");
+            break;
+        }
+        ret = read(p->fd, buf, sizeof(buf));
+        now = boottime_ns();
+        if(ret <= 0)
+        {
+            if(ret == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                perror("Read failed");
+                running = 0;
+            }
+            continue;
+        }
+        for(offset = 0; offset < (size_t)ret; offset += consumed)
+        {
+            switch(ydlidar_parse(parser, buf + offset, ret - offset, now, &consumed))
+            {
+                case YDLIDAR_PARSE_RESPONSE:
+                    parser->resp_type = 0;
+                    break;
+                case YDLIDAR_PARSE_PACKET:
+                    parser->resp_type = 0;
+                    slot = spsc_reserve(&p->raw);
+                    if(!slot)
+                    {
+                        count(&p->read_drops);
+                        break;
+                    }
+                    slot->header.timestamp_ns = parser->timestamp_ns;
+                    slot->header.sample_period_ns = TTY_SAMPLE_PERIOD_NS;
+                    slot->header.length = parser->len;
+                    memcpy(slot->packet, parser->frame, parser->len);
+                    spsc_publish(&p->raw);
+                    count(&p->packets_read);
+                    break;
+                case YDLIDAR_PARSE_MORE:
+                    break;
+            }
+        }
+    }
+    //Hung up (an emulator run ended), send what was already read before shutting down
+    while(running && (spsc_depth(&p->raw) || spsc_depth(&p->points)))
+    {
+        usleep(1000);
+    }
+    running = 0;
+    return NULL;
+}
 
+static void *decoder_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    struct raw_slot *raw;
+    struct points_slot *out;
 
-   int sockfd;
-   struct sockaddr_in servaddr;
-   float send_buffer[ARRAY_SIZE];
-   // Create UDP socket
-    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
-        perror("socket creation failed");
-        exit(EXIT_FAILURE);
+    while(running)
+    {
+        raw = spsc_peek(&p->raw);
+        if(!raw)
+        {
+            spsc_wait(&p->raw, WAIT_MS);
+            continue;
+        }
+        out = spsc_reserve(&p->points);
+        if(!out && p->lossless)
+        {
+            usleep(100);
+            continue;
+        }
+        if(!out)
+        {
+            count(&p->decode_drops);
+            spsc_release(&p->raw);
+            continue;
+        }
+        out->count = lidar_decode_packet(raw->packet, raw->header.length, out->distance, out->angle);
+        if(out->count <= 0)
+        {
+            count(&p->decode_errors);
+            spsc_release(&p->raw);
+            continue;
+        }
+        out->timestamp_ns = raw->header.timestamp_ns;
+        out->start_of_scan = raw->packet[YDLIDAR_CT_OFFSET] & YDLIDAR_CT_START_BM;
+        //Publish first, so the packet is always in one of the queues until the sender has it
+        spsc_publish(&p->points);
+        spsc_release(&p->raw);
+        count(&p->packets_decoded);
     }
-    memset(&servaddr, 0, sizeof(servaddr));
-    // Filling server information
-    servaddr.sin_family = AF_INET;
-    servaddr.sin_port = htons(SERVER_PORT);
-    servaddr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    return NULL;
+}
 
-    int len = sizeof(servaddr);
+static void *sender_thread(void *arg)
+{
+    struct pipeline *p = arg;
+    struct points_slot *in;
 
+    while(running)
+    {
+        in = spsc_peek(&p->points);
+        if(!in)
+        {
+            //Packets trickle in every ~1.5 ms, give a partial batch a moment to fill before sending it
+            spsc_wait(&p->points, p->batch->count ? FLUSH_MS : WAIT_MS);
+            if(p->batch->count && !spsc_peek(&p->points))
+            {
+                udp_batch_flush(p->batch);
+            }
+            continue;
+        }
+        udp_batch_add(p->batch, in->distance, in->angle, in->count, in->timestamp_ns, in->start_of_scan);
+        spsc_release(&p->points);
+    }
+    udp_batch_flush(p->batch);
+    return NULL;
+}
 
+static uint64_t delta(_Atomic uint64_t *counter, uint64_t *last)
+{
+    uint64_t now = atomic_load_explicit(counter, memory_order_relaxed);
+    uint64_t d = now - *last;
+
+    *last = now;
+    return d;
+}
+
+/*
+ * @brief Print throughput and queue depth every interval seconds until shutdown
+ */
+static void stats_loop(struct pipeline *p, int interval)
+{
+    uint64_t last[7] = {0};
+    struct timespec tick = {0, WAIT_MS * 1000000L};
+    int elapsed_ms = 0;
+
+    while(running)
+    {
+        nanosleep(&tick, NULL);
+        elapsed_ms += WAIT_MS;
+        if(interval <= 0 || elapsed_ms < interval * 1000)
+        {
+            continue;
+        }
+        elapsed_ms = 0;
+        printf("read %.1f/s (dropped %" PRIu64 ") decoded %.1f/s (bad %" PRIu64 ", dropped %" PRIu64 ") "
+               "sent %.1f/s in %.1f sendmmsg/s | queue raw %u peak %u, points %u peak %u\n",
+               (double)delta(&p->packets_read, &last[0]) / interval, delta(&p->read_drops, &last[1]),
+               (double)delta(&p->packets_decoded, &last[2]) / interval, delta(&p->decode_errors, &last[3]),
+               delta(&p->decode_drops, &last[4]),
+               (double)delta(&p->batch->sent, &last[5]) / interval, (double)delta(&p->batch->calls, &last[6]) / interval,
+               spsc_depth(&p->raw), spsc_peak_depth(&p->raw), spsc_depth(&p->points), spsc_peak_depth(&p->points));
+        fflush(stdout);
+    }
+}
+
+/*
+ * @brief Map a capture log for replay
+ * @return The mapping, or NULL if the file is not a capture log
+ */
+static const unsigned char *map_capture(const char *path, size_t *size)
+{
+    unsigned char *base;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &st))
+    {
+        perror(path);
+        return NULL;
+    }
+    *size = st.st_size;
+    base = *size ? mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(base == MAP_FAILED || !capture_first(base, *size))
+    {
+        printf("%s is not a capture log\n", path);
+        if(base != MAP_FAILED)
+        {
+            munmap(base, *size);
+        }
+        return NULL;
+    }
+    //Replay walks the log front to back
+    madvise(base, *size, MADV_SEQUENTIAL);
+    return base;
+}
+
+/*
+ * @brief Open a serial port raw at 128000 baud, there is no B128000 so the rate is set through termios2
+ * @return fd, or -1 on failure
+ */
+static int open_tty(const char *path)
+{
+    struct termios2 tio;
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if(fd < 0 || ioctl(fd, TCGETS2, &tio))
+    {
+        perror(path);
+        if(fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    tio.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON | IXOFF);
+    tio.c_oflag &= ~OPOST;
+    tio.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
+    tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB | CRTSCTS | CBAUD | CIBAUD);
+    tio.c_cflag |= CS8 | CLOCAL | CREAD | BOTHER;
+    tio.c_ispeed = tio.c_ospeed = YDLIDAR_BAUDRATE;
+    if(ioctl(fd, TCSETS2, &tio))
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * @brief Continuously read (or replay), decode and send until SIGINT/SIGTERM, the device goes away or the replay ends
+ */
+static int run_daemon(int fd, struct udp_batch *batch, const struct options *opts)
+{
+    static struct pipeline p;
+    struct sigaction sa;
+    pthread_t reader, decoder, sender;
+    uint64_t start;
+    double seconds;
+
+    p.fd = fd;
+    p.batch = batch;
+    p.speed = opts->speed;
+    p.tty = opts->tty != NULL;
+    if(opts->replay)
+    {
+        p.replay = map_capture(opts->replay, &p.replay_size);
+        if(!p.replay)
+        {
+            return -1;
+        }
+        p.lossless = p.speed <= 0;
+    }
+    if(spsc_init(&p.raw, opts->queue_slots, sizeof(struct raw_slot)) ||
+       spsc_init(&p.points, opts->queue_slots, sizeof(struct points_slot)))
+    {
+        printf("Could not allocate the pipeline queues\n");
+        return -1;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    if(p.tty ? write(fd, tty_start_command, sizeof(tty_start_command)) != sizeof(tty_start_command) :
+       !p.replay && ioctl(fd, SEND_START_COMMAND, 0) < 0)
+    {
+        perror("Could not start scanning");
+        return -1;
+    }
+    start = monotonic_ns();
+    pthread_create(&reader, NULL, p.replay ? replay_thread : p.tty ? tty_thread : reader_thread, &p);
+    pthread_create(&decoder, NULL, decoder_thread, &p);
+    pthread_create(&sender, NULL, sender_thread, &p);
+    stats_loop(&p, opts->stats_interval);
+    pthread_join(reader, NULL);
+    pthread_join(decoder, NULL);
+    pthread_join(sender, NULL);
+    seconds = (monotonic_ns() - start) / 1e9;
+    printf("Total: read %" PRIu64 " decoded %" PRIu64 " sent %" PRIu64 " in %" PRIu64 " sendmmsg calls, %.2f s (%.1f packets/s)\n",
+           atomic_load(&p.packets_read), atomic_load(&p.packets_decoded), atomic_load(&p.batch->sent),
+           atomic_load(&p.batch->calls), seconds, atomic_load(&p.packets_decoded) / seconds);
+    if(p.replay)
+    {
+        munmap((void *)p.replay, p.replay_size);
+    }
+    else if(p.tty)
+    {
+        printf("Serial link: %lu good packets, %lu bad checksums, %lu resyncs\n",
+               p.parser.packets, p.parser.bad_checksum, p.parser.resyncs);
+        write(fd, tty_stop_command, sizeof(tty_stop_command));
+    }
+    else
+    {
+        ioctl(fd, SEND_STOP_COMMAND, 0);
+    }
+    spsc_free(&p.raw);
+    spsc_free(&p.points);
+    return 0;
+}
+
+/*
+ * @brief The original interactive menu, kept for bring up and debugging
+ */
+static int run_menu(int fd, struct udp_batch *batch)
+{
+	int packet_count;
+        char command;
+        float distance[LIDAR_DECODE_MAX_POINTS], angle[LIDAR_DECODE_MAX_POINTS];
+        int points;
+        //struct ydlidar_packet_header followed by the raw packet
+        unsigned char read_buf[sizeof(struct ydlidar_packet_header) + YDLIDAR_MAX_PACKET_SIZE];
+        struct ydlidar_packet_header *packet_header = (struct ydlidar_packet_header *)read_buf;
+        unsigned char *packet = read_buf + sizeof(struct ydlidar_packet_header);
 
-	int fd, packet_count;
-        char command, read_buf[500];
-	fd = open(DEVICE, O_RDWR);
-	if(fd == -1) {
-		printf("File %s either does not exist or has been locked by another "
-				"process\n", DEVICE);
-		exit(-1);
-	}
         while (1) {
         if(ioctl(fd, CURRENT_MODE, 0) == 1)
         {
@@ -122,154 +719,235 @@ int main(int argc, char *argv[]) {
                 }
    for(int i = 0; i < packet_count; i++){
 
-                if(read(fd, read_buf, sizeof(read_buf)) != 0)
+                //Driver returns one complete packet per read
+                if(read(fd, read_buf, sizeof(read_buf)) <= 0)
                 {
                     printf("Read failed (HINT: scan mode must be set first)!\n");
                     continue;
                 }
-                if(read_buf[0] == 0xAA && read_buf[1] == 0x55){
-                    //printf("\nValid header found\n");
-                    //printf("Packet type: %x\n",read_buf[2]);
-                    int packet_size = (int)read_buf[3];
-                    //printf("Packet size: %d\n",packet_size);
-                    uint8_t low_byte, high_byte;
-                    u_int16_t raw_value;
-                    float distance, diff, fsa, lsa, fsa_correct, lsa_correct, fsa_distance, lsa_distance, angle, angle_correct;
-                    low_byte = read_buf[4];
-                    high_byte = read_buf[5];
-                    raw_value = (u_int16_t)((high_byte << 8) | low_byte);
-                    fsa = (float)(raw_value>>1)/64;
-                    low_byte = read_buf[6];
-                    high_byte = read_buf[7];
-                    raw_value = (u_int16_t)((high_byte << 8) | low_byte);
-                    lsa = (float)(raw_value>>1)/64;
-
-                    //If last angle is more than first add 360, this happens when the last angle passes 360 degrees
-                    //This is done to preserve the interpolation of values between fsa and lsa
-                    if(lsa < fsa)
-                    {
-                        lsa += 360;
-                    }
-                    diff = lsa - fsa;
-
-                    //TO:DO - use checksum to validate packet
-
-                    //Calculate FSA corrected angle value
-                    low_byte = read_buf[10];
-                    high_byte = read_buf[11];
-                    raw_value = (u_int16_t)((high_byte << 8) | low_byte);
-                    fsa_distance = (float)raw_value / 4;
-
-                    if(fsa_distance == 0)
-                    {
-                        angle_correct = 0;
-                    }
-                    else
-                    {
-                        angle_correct = atan(21.8 * ((155.3 - fsa_distance)/(155.3*fsa_distance)));
-                        angle_correct = (angle_correct * 180) / PI;
-                    }
-                    //printf("FSA correct %.2f\n", angle_correct);
-                    fsa_correct = fsa + angle_correct;
-
-                    //Calculate LSA corrected angle value
-                    low_byte = read_buf[packet_size + 10];
-                    high_byte = read_buf[packet_size + 11];
-                    raw_value = (u_int16_t)((high_byte << 8) | low_byte);
-                    lsa_distance = (float)raw_value / 4;
-
-                    if(lsa_distance == 0)
-                    {
-                        angle_correct = 0;
-                    }
-                    else
-                    {
-                        angle_correct = atan(21.8 * ((155.3 - lsa_distance)/(155.3*lsa_distance)));
-                        angle_correct = (angle_correct * 180) / PI;
-                    }
-                    //printf("LSA correct %.2f\n", angle_correct);
-                    lsa_correct = lsa + angle_correct;
-
-                    //Normalize fsa to 0-360 degrees
-                    if(fsa_correct > 360)
-                    {
-                        fsa_correct -= 360;
-                    }
-                    else if(fsa_correct < 0)
-                    {
-                        fsa_correct += 360;
-                    }
-                    //Reset buffer
-                    memset(send_buffer, 0, ARRAY_SIZE * sizeof(float));
-                    send_buffer[0] = fsa_distance;
-                    send_buffer[1] = fsa_correct;
-                    //printf("Scan 1: Distance: %.2fmm Angle: %.2f\n", fsa_distance, fsa_correct);
-                    //TO:DO we must actually correct the lsa and fsa first before doing other math
-                    for(int x = 2; x < 2*packet_size - 2; x+=2)
-                    {
-                       int i = (x/2) + 1;
-                       low_byte = read_buf[x+10];
-                       high_byte = read_buf[x+11];
-                       raw_value = (u_int16_t)((high_byte << 8) | low_byte);
-                       distance = (float)raw_value / 4;
-                       //printf("Scan %d: Distance: %.2fmm ", i, distance);
-                       send_buffer[x] = distance;
-                       if(distance == 0)
-                       {
-                           angle_correct = 0;
-                       }
-                       else
-                       {
-                           angle_correct = atan(21.8 * ((155.3 - distance)/(155.3*distance)));
-                           angle_correct = (angle_correct * 180) / PI;
-                       }
-
-                       angle = ((diff/(packet_size-1)) * (i-1)) + fsa + angle_correct;
-                       //Normalize angle to 0-360 degrees
-                       if(angle > 360)
-                       {
-                           angle -= 360;
-                       }
-                       else if(angle < 0)
-                       {
-                           angle += 360;
-                       }
-                       send_buffer[x+1] = angle;
-                      // printf("Angle: %.2f\n", angle);
-                    }
-                    //Normalize angle to 0-360 degrees
-                    if(lsa_correct > 360)
-                    {
-                        lsa_correct -= 360;
-                    }
-                    else if(lsa_correct < 0)
-                    {
-                        lsa_correct += 360;
-                    }
-                    send_buffer[78] = lsa_distance;
-                    send_buffer[79] = lsa_correct;
-                    sendto(sockfd, send_buffer, sizeof(send_buffer), 0, (const struct sockaddr *)&servaddr, len);
-                    //printf("Data sent.\n");
-                    //printf("Scan %d: Distance: %.2fmm Angle: %.2f\n", packet_size, lsa_distance, lsa_correct);
-
+                points = lidar_decode_packet(packet, packet_header->length, distance, angle);
+                if(points > 0){
+                    udp_batch_add(batch, distance, angle, points, packet_header->timestamp_ns, packet[YDLIDAR_CT_OFFSET] & YDLIDAR_CT_START_BM);
                 }
                 else{
                     printf("NO VALID HEADER\n");
                 }
 }
+                //Do not hold back the tail of the run until the next one
+                udp_batch_flush(batch);
 
                 break;
             case '0':
-                // Exit the loop and close the file descriptor
-                close(fd);
+                // Exit the loop, main closes the file descriptor
                 return 0;
             default:
                 printf("Invalid command. Please enter a valid command (0-6).\n");
         }
     }
-  close(sockfd);
-    close(fd);
+}
+
+static const struct option long_options[] = {
+    {"device", required_argument, NULL, 'd'},
+    {"server", required_argument, NULL, 's'},
+    {"port", required_argument, NULL, 'p'},
+    {"interactive", no_argument, NULL, 'i'},
+    {"stats", required_argument, NULL, 't'},
+    {"queue", required_argument, NULL, 'q'},
+    {"config", required_argument, NULL, 'c'},
+    {"replay", required_argument, NULL, 'r'},
+    {"speed", required_argument, NULL, 'x'},
+    {"tty", required_argument, NULL, 'T'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "Streams decoded YDLIDAR X4 points to the GUI over UDP until interrupted\n"
+           "  -d, --device PATH     lidar character device (default " DEVICE ")\n"
+           "  -s, --server IP       GUI address (default " SERVER_IP ")\n"
+           "  -p, --port PORT       GUI port (default %d)\n"
+           "  -i, --interactive     run the command menu instead of streaming\n"
+           "  -t, --stats SECONDS   throughput report interval, 0 disables (default %d)\n"
+           "  -q, --queue SLOTS     packets buffered between threads, a power of 2 (default %d)\n"
+           "  -c, --config FILE     read options from FILE, one \"name value\" per line using the long names\n"
+           "  -r, --replay FILE     stream a lidar_capture log instead of the device\n"
+           "  -x, --speed FACTOR    replay rate relative to the capture, 0 for as fast as possible (default 1)\n"
+           "  -T, --tty PATH        parse an X4 on a serial port (or an x4_emulator pty) instead of the device\n",
+           name, SERVER_PORT, STATS_INTERVAL, QUEUE_SLOTS);
+}
+
+static int read_config(const char *path, struct options *opts);
+
+/*
+ * @return 0, or -1 if the option or its value is invalid
+ */
+static int apply_option(int opt, const char *value, struct options *opts)
+{
+    switch(opt)
+    {
+        case 'd':
+            opts->device = strdup(value);
+            break;
+        case 's':
+            opts->server = strdup(value);
+            break;
+        case 'p':
+            opts->port = atoi(value);
+            if(opts->port <= 0 || opts->port > 65535)
+            {
+                printf("Invalid port %s\n", value);
+                return -1;
+            }
+            break;
+        case 'i':
+            opts->interactive = true;
+            break;
+        case 't':
+            opts->stats_interval = atoi(value);
+            break;
+        case 'q':
+            opts->queue_slots = atoi(value);
+            if(opts->queue_slots < 2 || (opts->queue_slots & (opts->queue_slots - 1)))
+            {
+                printf("Queue size %s is not a power of 2\n", value);
+                return -1;
+            }
+            break;
+        case 'c':
+            return read_config(value, opts);
+        case 'r':
+            opts->replay = strdup(value);
+            break;
+        case 'x':
+            opts->speed = strtod(value, NULL);
+            if(opts->speed < 0)
+            {
+                printf("Invalid replay speed %s\n", value);
+                return -1;
+            }
+            break;
+        case 'T':
+            opts->tty = strdup(value);
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+static int read_config(const char *path, struct options *opts)
+{
+    char line[256], name[64], value[192];
+    const struct option *o;
+    FILE *f = fopen(path, "r");
+    int fields;
+
+    if(!f)
+    {
+        perror(path);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+        fields = sscanf(line, " %63s %191s", name, value);
+        if(fields < 1 || name[0] == '#')
+        {
+            continue;
+        }
+        for(o = long_options; o->name && strcmp(o->name, name); o++);
+        //A config file including itself would never end
+        if(!o->name || o->val == 'c' || o->val == 'h' || (o->has_arg == required_argument && fields < 2) ||
+           apply_option(o->val, value, opts))
+        {
+            printf("%s: invalid line: %s", path, line);
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
     return 0;
 }
 
+int main(int argc, char *argv[]) {
+   struct options opts = {DEVICE, SERVER_IP, SERVER_PORT, false, STATS_INTERVAL, QUEUE_SLOTS, NULL, 1, NULL};
+   int sockfd, fd = -1, opt, ret;
+   struct sockaddr_in servaddr;
+   static struct udp_batch batch;
+
+    while((opt = getopt_long(argc, argv, "d:s:p:it:q:c:r:x:T:h", long_options, NULL)) != -1)
+    {
+        if(opt == 'h' || apply_option(opt, optarg, &opts))
+        {
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if((opts.replay || opts.tty) && opts.interactive)
+    {
+        printf("The menu needs the driver, it can not be used with --replay or --tty\n");
+        return 1;
+    }
+    if(opts.replay && opts.tty)
+    {
+        printf("--replay and --tty are different sources, pick one\n");
+        return 1;
+    }
+
+   // Create UDP socket
+    if ((sockfd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        perror("socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    memset(&servaddr, 0, sizeof(servaddr));
+    // Filling server information
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons(opts.port);
+    if(inet_pton(AF_INET, opts.server, &servaddr.sin_addr) != 1)
+    {
+        printf("Invalid server address %s\n", opts.server);
+        exit(EXIT_FAILURE);
+    }
+
+    batch.sockfd = sockfd;
+    batch.addr = &servaddr;
 
+        if(opts.replay)
+        {
+            ret = run_daemon(-1, &batch, &opts);
+            close(sockfd);
+            return ret ? EXIT_FAILURE : 0;
+        }
+        if(opts.tty)
+        {
+            fd = open_tty(opts.tty);
+            ret = fd < 0 ? -1 : run_daemon(fd, &batch, &opts);
+            close(sockfd);
+            if(fd >= 0)
+            {
+                close(fd);
+            }
+            return ret ? EXIT_FAILURE : 0;
+        }
+	//The pipeline polls the device, the menu blocks in read
+	fd = open(opts.device, opts.interactive ? O_RDWR : O_RDWR | O_NONBLOCK);
+	if(fd == -1) {
+		printf("File %s either does not exist or has been locked by another "
+				"process\n", opts.device);
+		exit(-1);
+	}
+        //Read format is kept by the driver between opens, this app decodes single timestamped packets
+        ioctl(fd, SET_READ_FORMAT, YDLIDAR_FMT_PACKET_TS);
+        if(opts.interactive)
+        {
+            ret = run_menu(fd, &batch);
+        }
+        else
+        {
+            ret = run_daemon(fd, &batch, &opts);
+        }
+  close(sockfd);
+    close(fd);
+    return ret ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,602 @@
+/*
+ * Software YDLIDAR X4 on a pseudo terminal, for testing the parser and userapp without hardware
+ * Answers the X4 commands and streams scan packets of a simulated room at the X4's sample rate, optionally
+ * fragmenting writes and injecting noise, checksum errors and dropped bytes.
+ * Usage: ./x4_emulator [options], then point userapp --tty (or anything else speaking the X4 protocol) at the printed pty
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ydlidar_x4_parser.h"
+
+#define PI 3.141592654
+//X4 defaults: 5 kHz sample rate, motor at ~7 Hz
+#define EMU_SAMPLE_RATE 5000
+#define EMU_FREQUENCY 7.0
+//Samples per packet the X4 sends, the start of scan packet carries a single one
+#define EMU_PACKET_SAMPLES 40
+//Room the emulated lidar sits in, walls in mm from the lidar
+#define EMU_ROOM_X 2500.0
+#define EMU_ROOM_Y 1800.0
+//Round pillar in the room, center and radius in mm
+#define EMU_PILLAR_X 900.0
+#define EMU_PILLAR_Y -600.0
+#define EMU_PILLAR_R 150.0
+//Share of samples with no return (distance 0)
+#define EMU_INVALID_PERCENT 2
+//Most garbage bytes injected at once
+#define EMU_NOISE_MAX 16
+//Model code of the X4 in the device info reply
+#define EMU_MODEL 6
+//Longest poll sleep, so signals and stop conditions are noticed promptly
+#define EMU_WAIT_MS 100
+
+struct emu_options {
+    const char *link;
+    int sample_rate;
+    double frequency;
+    //Time scale, 0 streams as fast as the reader drains the pty
+    double speed;
+    //Largest write when fragmenting, 0 writes whole frames
+    int fragment;
+    //Probabilities per frame
+    double noise;
+    double errors;
+    double drops;
+    unsigned int seed;
+    bool autostart;
+    //Exit after this many packets, 0 runs until interrupted
+    unsigned long count;
+};
+
+struct emu_stats {
+    unsigned long packets;
+    unsigned long samples;
+    unsigned long revolutions;
+    unsigned long corrupted;
+    unsigned long noise_bytes;
+    unsigned long dropped_bytes;
+    //Bytes lost because the reader was not draining the pty, like a UART receiver overrun
+    unsigned long overruns;
+    unsigned long commands;
+};
+
+struct emulator {
+    const struct emu_options *opts;
+    struct emu_stats stats;
+    int master;
+    bool scanning;
+    //Sample index within the current revolution, samples per revolution
+    int sample;
+    int samples_per_rev;
+    //When the next packet is due on CLOCK_MONOTONIC
+    uint64_t due_ns;
+    //Command bytes received so far
+    unsigned char cmd[2];
+    int cmd_len;
+};
+
+static volatile sig_atomic_t running = 1;
+
+static void handle_signal(int sig)
+{
+    running = 0;
+}
+
+static uint64_t monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static bool chance(double p)
+{
+    return p > 0 && rand() < p * ((double)RAND_MAX + 1);
+}
+
+/*
+ * @brief Distance from the lidar to the room along angle
+ * @return Distance in mm, 0 for no return
+ */
+static double scene_distance(double angle)
+{
+    double dx = cos(angle * PI / 180), dy = sin(angle * PI / 180);
+    double d = INFINITY, t, b, c, disc;
+
+    if(rand() % 100 < EMU_INVALID_PERCENT)
+    {
+        return 0;
+    }
+    if(fabs(dx) > 1e-9)
+    {
+        d = fmin(d, (dx > 0 ? EMU_ROOM_X : -EMU_ROOM_X) / dx);
+    }
+    if(fabs(dy) > 1e-9)
+    {
+        d = fmin(d, (dy > 0 ? EMU_ROOM_Y : -EMU_ROOM_Y) / dy);
+    }
+    //Ray against the pillar: |t * dir - center|^2 = r^2
+    b = dx * EMU_PILLAR_X + dy * EMU_PILLAR_Y;
+    c = EMU_PILLAR_X * EMU_PILLAR_X + EMU_PILLAR_Y * EMU_PILLAR_Y - EMU_PILLAR_R * EMU_PILLAR_R;
+    disc = b * b - c;
+    if(disc >= 0 && (t = b - sqrt(disc)) > 0)
+    {
+        d = fmin(d, t);
+    }
+    //A few mm of range noise like the real sensor
+    return d + (rand() % 9 - 4);
+}
+
+/*
+ * @brief Write a frame to the pty, in random pieces when fragmenting
+ * Paced output gives every piece its time on the wire so the reader sees it in a separate read
+ * @return 0, or -1 if the pty failed
+ */
+static int emu_write(struct emulator *emu, const unsigned char *data, size_t len)
+{
+    struct pollfd pfd = {emu->master, POLLOUT, 0};
+    uint64_t start = monotonic_ns(), sent = 0, due;
+    struct timespec ts;
+    size_t piece;
+    ssize_t ret;
+
+    while(len && running)
+    {
+        piece = emu->opts->fragment ? 1 + (size_t)(rand() % emu->opts->fragment) : len;
+        if(piece > len)
+        {
+            piece = len;
+        }
+        ret = write(emu->master, data, piece);
+        if(ret < 0 && errno == EAGAIN)
+        {
+            if(emu->opts->speed > 0)
+            {
+                //Real time output can not wait for the reader, the bytes are lost
+                emu->stats.overruns += len;
+                return 0;
+            }
+            poll(&pfd, 1, EMU_WAIT_MS);
+            continue;
+        }
+        if(ret < 0)
+        {
+            perror("pty write failed");
+            return -1;
+        }
+        data += ret;
+        len -= ret;
+        sent += ret;
+        if(len && emu->opts->fragment && emu->opts->speed > 0)
+        {
+            //Against the start of the frame, so sleep overhead does not add up over the pieces
+            due = start + (uint64_t)(sent * YDLIDAR_BYTE_NS / emu->opts->speed);
+            ts.tv_sec = due / 1000000000ULL;
+            ts.tv_nsec = due % 1000000000ULL;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+    }
+    return 0;
+}
+
+/*
+ * @brief Reply to a command with a response descriptor and its payload
+ */
+static int emu_respond(struct emulator *emu, unsigned char type, bool continuous, const unsigned char *payload, uint32_t len)
+{
+    unsigned char frame[YDLIDAR_RESP_DESC_SIZE + YDLIDAR_RESP_MAX_SIZE];
+    //The scan start reply announces the 5 byte sample size of its stream but sends no payload itself
+    uint32_t word = (continuous ? 5 : len) | (continuous ? (uint32_t)YDLIDAR_RESP_MODE_CONTINUOUS << 24 : 0);
+
+    frame[0] = YDLIDAR_RESP_SYNC_LOW;
+    frame[1] = YDLIDAR_RESP_SYNC_HIGH;
+    frame[YDLIDAR_RESP_LEN_OFFSET] = word & 0xFF;
+    frame[YDLIDAR_RESP_LEN_OFFSET + 1] = (word >> 8) & 0xFF;
+    frame[YDLIDAR_RESP_LEN_OFFSET + 2] = (word >> 16) & 0xFF;
+    frame[YDLIDAR_RESP_LEN_OFFSET + 3] = word >> 24;
+    frame[YDLIDAR_RESP_TYPE_OFFSET] = type;
+    if(len)
+    {
+        memcpy(frame + YDLIDAR_RESP_DESC_SIZE, payload, len);
+    }
+    return emu_write(emu, frame, YDLIDAR_RESP_DESC_SIZE + len);
+}
+
+static void emu_start(struct emulator *emu)
+{
+    emu->scanning = true;
+    emu->sample = 0;
+    emu->due_ns = monotonic_ns();
+}
+
+static int emu_command(struct emulator *emu, unsigned char cmd)
+{
+    //model, firmware minor, firmware major, hardware, 16 byte serial
+    unsigned char info[YDLIDAR_RESP_INFO_SIZE] = {EMU_MODEL, 2, 1, 1};
+    //status, 16 bit error code
+    unsigned char health[YDLIDAR_RESP_HEALTH_SIZE] = {YDLIDAR_HEALTH_OK, 0, 0};
+
+    emu->stats.commands++;
+    switch(cmd)
+    {
+        case YDLIDAR_CMD_START_SCAN:
+            fprintf(stderr, "start scan\n");
+            emu_start(emu);
+            return emu_respond(emu, YDLIDAR_RESP_TYPE_SCAN, true, NULL, 0);
+        case YDLIDAR_CMD_STOP_SCAN:
+            fprintf(stderr, "stop scan\n");
+            emu->scanning = false;
+            return 0;
+        case YDLIDAR_CMD_DEVICE_INFO:
+            for(int i = 0; i < 16; i++)
+            {
+                info[4 + i] = i % 10;
+            }
+            return emu_respond(emu, YDLIDAR_RESP_TYPE_INFO, false, info, sizeof(info));
+        case YDLIDAR_CMD_HEALTH:
+            return emu_respond(emu, YDLIDAR_RESP_TYPE_HEALTH, false, health, sizeof(health));
+        case YDLIDAR_CMD_REBOOT:
+            fprintf(stderr, "reboot\n");
+            emu->scanning = false;
+            return 0;
+        default:
+            fprintf(stderr, "unknown command 0x%02X\n", cmd);
+            return 0;
+    }
+}
+
+/*
+ * @brief Read and act on command bytes from the host
+ */
+static int emu_read_commands(struct emulator *emu)
+{
+    unsigned char buf[64];
+    ssize_t ret = read(emu->master, buf, sizeof(buf));
+
+    if(ret < 0)
+    {
+        return errno == EAGAIN || errno == EIO ? 0 : -1;
+    }
+    for(ssize_t i = 0; i < ret; i++)
+    {
+        if(emu->cmd_len == 0 && buf[i] != YDLIDAR_CMD_SYNC)
+        {
+            continue;
+        }
+        emu->cmd[emu->cmd_len++] = buf[i];
+        if(emu->cmd_len == 2)
+        {
+            emu->cmd_len = 0;
+            if(emu_command(emu, emu->cmd[1]))
+            {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void put_u16(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+/*
+ * @brief Build the next scan packet of the revolution
+ * @return Packet length
+ */
+static size_t emu_packet(struct emulator *emu, unsigned char *packet)
+{
+    bool start = emu->sample == 0;
+    int lsn = start ? 1 : EMU_PACKET_SAMPLES;
+    double step = 360.0 / emu->samples_per_rev, first, last, distance;
+    size_t len;
+
+    if(emu->sample + lsn > emu->samples_per_rev)
+    {
+        lsn = emu->samples_per_rev - emu->sample;
+    }
+    first = emu->sample * step;
+    last = (emu->sample + lsn - 1) * step;
+    packet[0] = YDLIDAR_PH_LOW;
+    packet[1] = YDLIDAR_PH_HIGH;
+    packet[YDLIDAR_CT_OFFSET] = start ? YDLIDAR_CT_START_BM : 0;
+    packet[YDLIDAR_LSN_OFFSET] = lsn;
+    //Angles are q6 degrees shifted up past the check bit, which is always set
+    put_u16(packet + YDLIDAR_FSA_OFFSET, ((unsigned int)lround(first * 64) << 1) | 1);
+    put_u16(packet + YDLIDAR_LSA_OFFSET, ((unsigned int)lround(last * 64) << 1) | 1);
+    for(int i = 0; i < lsn; i++)
+    {
+        distance = scene_distance(first + i * step);
+        put_u16(packet + YDLIDAR_HEADER_SIZE + 2 * i, (unsigned int)lround(distance * 4));
+    }
+    len = YDLIDAR_HEADER_SIZE + 2 * lsn;
+    put_u16(packet + YDLIDAR_CS_OFFSET, ydlidar_packet_checksum(packet, len));
+    emu->sample += lsn;
+    if(emu->sample >= emu->samples_per_rev)
+    {
+        emu->sample = 0;
+        emu->stats.revolutions++;
+    }
+    emu->stats.packets++;
+    emu->stats.samples += lsn;
+    return len;
+}
+
+/*
+ * @brief Send the next packet with whatever faults were asked for
+ */
+static int emu_send_packet(struct emulator *emu)
+{
+    unsigned char packet[YDLIDAR_MAX_PACKET_SIZE], noise[EMU_NOISE_MAX];
+    size_t len = emu_packet(emu, packet), n, at;
+    int lsn = packet[YDLIDAR_LSN_OFFSET];
+
+    if(chance(emu->opts->noise))
+    {
+        n = 1 + rand() % EMU_NOISE_MAX;
+        for(size_t i = 0; i < n; i++)
+        {
+            noise[i] = rand();
+        }
+        emu->stats.noise_bytes += n;
+        if(emu_write(emu, noise, n))
+        {
+            return -1;
+        }
+    }
+    if(chance(emu->opts->errors))
+    {
+        //Flip a bit anywhere past the header sync, the checksum no longer matches (or LSN is now wrong)
+        packet[2 + rand() % (len - 2)] ^= 1 << (rand() % 8);
+        emu->stats.corrupted++;
+    }
+    if(chance(emu->opts->drops))
+    {
+        //Lose a run of bytes, like a receiver overrun
+        at = rand() % len;
+        n = 1 + rand() % (len - at);
+        memmove(packet + at, packet + at + n, len - at - n);
+        len -= n;
+        emu->stats.dropped_bytes += n;
+    }
+    //The X4 sends a packet once its samples have been measured
+    emu->due_ns += (uint64_t)(lsn * 1e9 / emu->opts->sample_rate / (emu->opts->speed > 0 ? emu->opts->speed : 1));
+    return emu_write(emu, packet, len);
+}
+
+/*
+ * @brief Create the pty, raw so no byte is translated, and print (or link) its slave
+ * @return Master fd, or -1 on failure
+ */
+static int emu_open_pty(const struct emu_options *opts, int *slave)
+{
+    struct termios tio;
+    const char *name;
+    int master = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+    if(master < 0 || grantpt(master) || unlockpt(master) || !(name = ptsname(master)))
+    {
+        perror("Could not create a pty");
+        return -1;
+    }
+    //Holding the slave open keeps the pty alive while clients come and go
+    *slave = open(name, O_RDWR | O_NOCTTY);
+    if(*slave < 0 || tcgetattr(*slave, &tio))
+    {
+        perror(name);
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(*slave, TCSANOW, &tio);
+    if(opts->link)
+    {
+        unlink(opts->link);
+        if(symlink(name, opts->link))
+        {
+            perror(opts->link);
+            return -1;
+        }
+    }
+    printf("%s\n", opts->link ? opts->link : name);
+    fflush(stdout);
+    return master;
+}
+
+static const struct option long_options[] = {
+    {"link", required_argument, NULL, 'l'},
+    {"rate", required_argument, NULL, 'r'},
+    {"frequency", required_argument, NULL, 'f'},
+    {"speed", required_argument, NULL, 'x'},
+    {"fragment", required_argument, NULL, 'F'},
+    {"noise", required_argument, NULL, 'n'},
+    {"errors", required_argument, NULL, 'e'},
+    {"drops", required_argument, NULL, 'D'},
+    {"seed", required_argument, NULL, 'S'},
+    {"autostart", no_argument, NULL, 'a'},
+    {"count", required_argument, NULL, 'c'},
+    {"help", no_argument, NULL, 'h'},
+    {NULL, 0, NULL, 0}
+};
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options]\n"
+           "Emulates a YDLIDAR X4 on a pseudo terminal, prints the tty to open and runs until interrupted\n"
+           "  -l, --link PATH         also reach the pty through a symlink at PATH\n"
+           "  -r, --rate HZ           samples per second (default %d)\n"
+           "  -f, --frequency HZ      revolutions per second (default %.0f)\n"
+           "  -x, --speed FACTOR      stream rate relative to real time, 0 for as fast as the reader drains (default 1)\n"
+           "  -F, --fragment BYTES    write frames in random pieces of up to BYTES\n"
+           "  -n, --noise P           chance of garbage bytes before a packet\n"
+           "  -e, --errors P          chance of a flipped bit in a packet\n"
+           "  -D, --drops P           chance of a run of bytes missing from a packet\n"
+           "  -S, --seed N            random seed, runs with the same seed send the same faults\n"
+           "  -a, --autostart         stream without waiting for the start command\n"
+           "  -c, --count N           exit after N packets\n",
+           name, EMU_SAMPLE_RATE, EMU_FREQUENCY);
+}
+
+/*
+ * @return 0, or -1 if a probability is outside 0..1
+ */
+static int check_probability(const char *name, double p)
+{
+    if(p < 0 || p > 1)
+    {
+        printf("Invalid %s probability %g\n", name, p);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    struct emu_options opts = {NULL, EMU_SAMPLE_RATE, EMU_FREQUENCY, 1, 0, 0, 0, 0, 1, false, 0};
+    static struct emulator emu;
+    struct pollfd pfd;
+    struct sigaction sa;
+    int opt, slave, timeout, queued;
+    uint64_t now;
+
+    while((opt = getopt_long(argc, argv, "l:r:f:x:F:n:e:D:S:ac:h", long_options, NULL)) != -1)
+    {
+        switch(opt)
+        {
+            case 'l':
+                opts.link = optarg;
+                break;
+            case 'r':
+                opts.sample_rate = atoi(optarg);
+                break;
+            case 'f':
+                opts.frequency = strtod(optarg, NULL);
+                break;
+            case 'x':
+                opts.speed = strtod(optarg, NULL);
+                break;
+            case 'F':
+                opts.fragment = atoi(optarg);
+                break;
+            case 'n':
+                opts.noise = strtod(optarg, NULL);
+                break;
+            case 'e':
+                opts.errors = strtod(optarg, NULL);
+                break;
+            case 'D':
+                opts.drops = strtod(optarg, NULL);
+                break;
+            case 'S':
+                opts.seed = strtoul(optarg, NULL, 0);
+                break;
+            case 'a':
+                opts.autostart = true;
+                break;
+            case 'c':
+                opts.count = strtoul(optarg, NULL, 0);
+                break;
+            case 'h':
+                usage(argv[0]);
+                return 0;
+            default:
+                usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if(opts.sample_rate <= 0 || opts.frequency <= 0 || opts.speed < 0 || opts.fragment < 0 ||
+       check_probability("noise", opts.noise) || check_probability("error", opts.errors) || check_probability("drop", opts.drops))
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    srand(opts.seed);
+    emu.opts = &opts;
+    emu.samples_per_rev = (int)(opts.sample_rate / opts.frequency);
+    if(emu.samples_per_rev < 2)
+    {
+        printf("Sample rate %d is too low for %g revolutions per second\n", opts.sample_rate, opts.frequency);
+        return EXIT_FAILURE;
+    }
+    emu.master = emu_open_pty(&opts, &slave);
+    if(emu.master < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    if(opts.autostart)
+    {
+        emu_start(&emu);
+    }
+
+    while(running && (!opts.count || emu.stats.packets < opts.count))
+    {
+        timeout = EMU_WAIT_MS;
+        if(emu.scanning)
+        {
+            now = monotonic_ns();
+            if(opts.speed <= 0 || now >= emu.due_ns)
+            {
+                if(emu_send_packet(&emu))
+                {
+                    break;
+                }
+                timeout = 0;
+            }
+            else if((emu.due_ns - now) / 1000000 < EMU_WAIT_MS)
+            {
+                timeout = (emu.due_ns - now) / 1000000;
+            }
+        }
+        pfd.fd = emu.master;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, timeout) > 0 && (pfd.revents & POLLIN) && emu_read_commands(&emu))
+        {
+            perror("pty read failed");
+            break;
+        }
+        //Sub millisecond waits for the next packet
+        if(emu.scanning && opts.speed > 0 && (now = monotonic_ns()) < emu.due_ns && emu.due_ns - now < 1000000)
+        {
+            usleep((emu.due_ns - now) / 1000);
+        }
+    }
+
+    fprintf(stderr, "%lu packets, %lu samples, %lu revolutions, %lu commands | injected %lu corrupted packets, "
+            "%lu noise bytes, %lu dropped bytes | %lu bytes overrun\n",
+            emu.stats.packets, emu.stats.samples, emu.stats.revolutions, emu.stats.commands, emu.stats.corrupted,
+            emu.stats.noise_bytes, emu.stats.dropped_bytes, emu.stats.overruns);
+    //Give the reader a moment to take what is still queued, closing the master throws it away
+    for(int i = 0; i < 10 && !ioctl(slave, FIONREAD, &queued) && queued; i++)
+    {
+        usleep(EMU_WAIT_MS * 100);
+    }
+    if(opts.link)
+    {
+        unlink(opts.link);
+    }
+    close(emu.master);
+    close(slave);
+    return 0;
+}
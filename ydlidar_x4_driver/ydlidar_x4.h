@@ -0,0 +1,171 @@
+#ifndef YDLIDAR_X4_H
+#define YDLIDAR_X4_H
+
+/*
+ * Interface shared between the YDLIDAR X4 driver and user space
+ */
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define START_IOC_MAGIC 'Z'
+#define SEND_START_COMMAND _IOW(START_IOC_MAGIC, 1, unsigned long)
+
+#define STOP_IOC_MAGIC 'Y'
+#define SEND_STOP_COMMAND _IOW(STOP_IOC_MAGIC, 1, unsigned long)
+
+#define INFO_IOC_MAGIC 'X'
+#define SEND_INFO_COMMAND _IOW(INFO_IOC_MAGIC, 1, unsigned long)
+//Fails with EBUSY while scanning, ETIMEDOUT if the unit does not answer
+#define GET_DEVICE_INFO _IOR(INFO_IOC_MAGIC, 2, struct ydlidar_device_info)
+
+#define STATUS_IOC_MAGIC 'W'
+#define SEND_STATUS_COMMAND _IOW(STATUS_IOC_MAGIC, 1, unsigned long)
+//Fails with EBUSY while scanning, ETIMEDOUT if the unit does not answer
+#define GET_HEALTH _IOR(STATUS_IOC_MAGIC, 2, struct ydlidar_health)
+
+#define REBOOT_IOC_MAGIC 'V'
+#define SEND_REBOOT_COMMAND _IOW(REBOOT_IOC_MAGIC, 1, unsigned long)
+
+#define MODE_IOC_MAGIC 'U'
+#define CURRENT_MODE _IOW(MODE_IOC_MAGIC, 1, unsigned long)
+
+//Scan frequency in mHz, see struct ydlidar_scan_frequency
+#define FREQ_IOC_MAGIC 'S'
+#define GET_SCAN_FREQUENCY _IOR(FREQ_IOC_MAGIC, 1, struct ydlidar_scan_frequency)
+//Argument is the target in mHz, 0 stops regulating. EOPNOTSUPP without a motor PWM
+#define SET_SCAN_FREQUENCY _IOW(FREQ_IOC_MAGIC, 2, __u32)
+
+//Argument is one of the YDLIDAR_FMT_* values below
+#define FORMAT_IOC_MAGIC 'T'
+#define SET_READ_FORMAT _IOW(FORMAT_IOC_MAGIC, 1, unsigned long)
+
+struct ydlidar_device_info {
+        __u8 model;
+        __u8 firmware_major;
+        __u8 firmware_minor;
+        __u8 hardware;
+        __u8 serial[16];
+};
+
+//Values of ydlidar_health.status
+#define YDLIDAR_HEALTH_OK 0
+#define YDLIDAR_HEALTH_WARNING 1
+#define YDLIDAR_HEALTH_ERROR 2
+
+struct ydlidar_health {
+        __u8 status;
+        __u8 reserved;
+        __u16 error_code;
+};
+
+/*
+ * The X4 has no command to change its scan frequency, the motor speed is set by the voltage on M_CTR.
+ * If the device tree gives the driver a PWM driving M_CTR ("pwms"), SET_SCAN_FREQUENCY regulates the
+ * duty cycle against the measured revolution rate. A higher duty cycle is assumed to spin the motor
+ * faster, use PWM_POLARITY_INVERTED in the pwms specifier if the board inverts it.
+ */
+struct ydlidar_scan_frequency {
+        //Measured from the time between start of scan packets, 0 until a revolution has been seen
+        __u32 measured_mhz;
+        //Set by SET_SCAN_FREQUENCY, 0 if not regulating
+        __u32 target_mhz;
+};
+
+//10 byte packet header followed by up to 255 16 bit samples
+#define YDLIDAR_MAX_PACKET_SIZE 520
+
+//Each read returns one raw scan packet (default)
+#define YDLIDAR_FMT_PACKET 0
+//Each read returns one complete revolution: struct ydlidar_scan_header followed by the raw packets
+#define YDLIDAR_FMT_SCAN 1
+//Each read returns one decoded packet: struct ydlidar_points_header followed by count struct ydlidar_point
+#define YDLIDAR_FMT_POINTS 2
+//Each read returns struct ydlidar_packet_header followed by one raw scan packet
+#define YDLIDAR_FMT_PACKET_TS 3
+
+/*
+ * Timestamps are CLOCK_BOOTTIME, taken when the first byte of a packet was received (corrected for the
+ * bytes still queued behind it in the UART). The X4 transmits a packet after measuring its samples, so
+ * sample i (0 based) of a packet with n samples was measured at about
+ *   timestamp_ns - (n - i) * sample_period_ns
+ * sample_period_ns is measured from the time between start of scan packets and the samples in between.
+ */
+
+struct ydlidar_packet_header {
+        __u64 timestamp_ns;
+        __u32 sample_period_ns;
+        //Bytes of raw packet following this header
+        __u32 length;
+};
+
+//Recommended read size for YDLIDAR_FMT_SCAN, enough for a revolution at the slowest motor speed
+#define YDLIDAR_MAX_SCAN_SIZE 16384
+
+struct ydlidar_scan_header {
+        //Arrival of the start of scan packet
+        __u64 timestamp_ns;
+        //Bytes of raw packets following this header
+        __u32 length;
+        //Samples in the revolution, the sum of LSN over all packets
+        __u32 sample_count;
+        //Packets in the revolution, the first is always the start of scan packet
+        __u32 packet_count;
+        __u32 sample_period_ns;
+};
+
+//Packet began a new revolution (CT bit 0)
+#define YDLIDAR_POINTS_START_OF_SCAN 0x01
+
+struct ydlidar_points_header {
+        //Arrival of the packet
+        __u64 timestamp_ns;
+        //Number of struct ydlidar_point following this header
+        __u32 count;
+        //YDLIDAR_POINTS_* flags
+        __u32 flags;
+        __u32 sample_period_ns;
+        __u32 reserved;
+};
+
+struct ydlidar_point {
+        //Distance in 1/4 mm, 0 when the sample is invalid
+        __u16 distance_q2;
+        //Corrected angle in 1/64 degree, 0 to 360 degrees
+        __u16 angle_q6;
+};
+
+/*
+ * mmap of the character device maps the driver's packet ring, so packets can be consumed in place.
+ * The mapping starts with struct ydlidar_ring_ctrl, map its first page to learn map_size, then map
+ * map_size bytes (MAP_SHARED, read/write). Slot i lives at data_offset + (i % slot_count) * slot_size.
+ *
+ * head is advanced by the driver once a slot is filled, tail is advanced by the consumer once it is
+ * done with a slot. Load head with acquire and store tail with release semantics, e.g.
+ * __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE). Use poll() to sleep until head != tail.
+ * Only one consumer may advance tail, so do not mix mmap consumption with read().
+ * poll() reports POLLERR alone while the lidar is not scanning and POLLHUP | POLLERR once it is removed.
+ */
+struct ydlidar_ring_ctrl {
+        __u32 head;
+        __u32 tail;
+        //Number of slots, a power of 2
+        __u32 slot_count;
+        //Bytes between consecutive slots
+        __u32 slot_size;
+        //Offset of slot 0 from the start of the mapping
+        __u32 data_offset;
+        //Total size of the mapping
+        __u32 map_size;
+};
+
+struct ydlidar_packet_slot {
+        //CLOCK_BOOTTIME when the header arrived
+        __u64 timestamp_ns;
+        __u32 sample_period_ns;
+        //Bytes of data used by the packet
+        __u16 len;
+        __u8 data[YDLIDAR_MAX_PACKET_SIZE];
+};
+
+#endif
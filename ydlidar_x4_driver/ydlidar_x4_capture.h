@@ -0,0 +1,98 @@
+#ifndef YDLIDAR_X4_CAPTURE_H
+#define YDLIDAR_X4_CAPTURE_H
+
+/*
+ * Capture log written by lidar_capture and replayed by userapp --replay
+ * struct capture_file_header, then records until the end of the file. Every record is
+ * struct capture_record followed by length bytes of payload, padded to CAPTURE_ALIGN, so the
+ * whole log can be mapped and walked in place. The log is only ever appended to, a capture
+ * that was cut short simply ends at its last complete record.
+ * All fields are little endian, timestamps are CLOCK_BOOTTIME.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define CAPTURE_MAGIC "X4CAPLOG"
+#define CAPTURE_VERSION 1
+#define CAPTURE_ALIGN 8
+
+//Payload is one raw X4 scan packet, aux is the driver's sample period in ns
+#define CAPTURE_RECORD_LIDAR 1
+//Payload is struct capture_imu_sample
+#define CAPTURE_RECORD_IMU 2
+
+struct capture_file_header {
+        char magic[8];
+        uint32_t version;
+        //Offset of the first record
+        uint32_t header_size;
+        //Clocks when the capture started, to line the log up with other recordings
+        uint64_t start_boottime_ns;
+        uint64_t start_realtime_ns;
+        //IIO scale of the raw IMU samples in nano g and nano dps per count, 0 if no IMU was captured
+        uint32_t accel_scale_nano;
+        uint32_t gyro_scale_nano;
+        uint8_t reserved[24];
+};
+
+struct capture_record {
+        uint16_t type;
+        uint16_t flags;
+        //Payload bytes following this header, not counting padding
+        uint32_t length;
+        uint64_t timestamp_ns;
+        uint32_t aux;
+        uint32_t reserved;
+};
+
+//Raw LSM6DS3 counts in IIO scan order
+struct capture_imu_sample {
+        int16_t accel[3];
+        int16_t gyro[3];
+};
+
+static inline size_t capture_record_size(uint32_t length)
+{
+        return (sizeof(struct capture_record) + length + CAPTURE_ALIGN - 1) & ~(size_t)(CAPTURE_ALIGN - 1);
+}
+
+/*
+ * @brief Check the file header of a mapped log
+ * @return Offset of the first record, or 0 if this is not a log we understand
+ */
+static inline size_t capture_first(const unsigned char *base, size_t size)
+{
+        const struct capture_file_header *hdr = (const struct capture_file_header *)base;
+
+        if(size < sizeof(*hdr) || memcmp(hdr->magic, CAPTURE_MAGIC, sizeof(hdr->magic)) ||
+           hdr->version != CAPTURE_VERSION || hdr->header_size < sizeof(*hdr) || hdr->header_size > size)
+        {
+            return 0;
+        }
+        return hdr->header_size;
+}
+
+/*
+ * @brief Record at *offset of a mapped log, advancing *offset past it
+ * @return The record, or NULL at the end of the log or at a torn final record
+ */
+static inline const struct capture_record *capture_next(const unsigned char *base, size_t size, size_t *offset)
+{
+        const struct capture_record *rec;
+
+        if(*offset + sizeof(*rec) > size)
+        {
+            return NULL;
+        }
+        rec = (const struct capture_record *)(base + *offset);
+        if(rec->length > size - *offset - sizeof(*rec))
+        {
+            return NULL;
+        }
+        *offset += capture_record_size(rec->length);
+        return rec;
+}
+
+#endif
@@ -0,0 +1,213 @@
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIDAR_DECODE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LIDAR_DECODE_SSE2
+#endif
+
+#include "ydlidar_x4_decode.h"
+#include "ydlidar_x4_points.h"
+
+//Angle correction from the X4 manual: atan(21.8 * (155.3 - d) / (155.3 * d)), rewritten as atan(K / d - K / D0)
+#define LIDAR_CORR_K 21.8f
+#define LIDAR_CORR_D0 155.3f
+#define LIDAR_PI_2 1.57079633f
+#define LIDAR_RAD_TO_DEG 57.2957795f
+
+//atan(r) ~= r * P(r^2) on [0, 1], least squares fit, max error 0.0007 degrees (the X4 reports angles in 1/64 degree)
+#define LIDAR_ATAN_C0 0.99986633f
+#define LIDAR_ATAN_C1 -0.330304764f
+#define LIDAR_ATAN_C2 0.180159164f
+#define LIDAR_ATAN_C3 -0.085156126f
+#define LIDAR_ATAN_C4 0.0208449955f
+
+/*
+ * @brief Validate the packet and work out the interpolation between FSA and LSA
+ * @param fsa_q6 Receives FSA and diff_q6 the angle spanned, both in 1/64 degree as ydlidar_packet_angles returns them
+ * @return LSN, or -1 if the packet is malformed
+ */
+static int lidar_decode_header(const uint8_t *packet, size_t len, int *fsa_q6, int *diff_q6, float *fsa, float *step)
+{
+        int lsn;
+
+        if(len < YDLIDAR_HEADER_SIZE || packet[0] != YDLIDAR_PH_LOW || packet[1] != YDLIDAR_PH_HIGH)
+        {
+            return -1;
+        }
+        lsn = ydlidar_packet_angles(packet, len, fsa_q6, diff_q6);
+        if(lsn < 0)
+        {
+            return -1;
+        }
+        *fsa = (float)*fsa_q6 / 64;
+        *step = lsn > 1 ? (float)*diff_q6 / 64 / (lsn - 1) : 0;
+        return lsn;
+}
+
+//Samples from first on through the shared fixed point decoder, converted to mm and degrees
+static void lidar_decode_samples_fixed(const uint8_t *packet, int first, int lsn, int fsa_q6, int diff_q6, float *distance, float *angle)
+{
+        __u16 distance_q2;
+
+        for(int i = first; i < lsn; i++)
+        {
+            distance_q2 = ydlidar_sample_q2(packet, i);
+            distance[i] = (float)distance_q2 / 4;
+            angle[i] = (float)ydlidar_sample_angle_q6(fsa_q6, diff_q6, lsn, i, distance_q2) / 64;
+        }
+}
+
+#if defined(LIDAR_DECODE_NEON)
+
+static float32x4_t lidar_div_neon(float32x4_t a, float32x4_t b)
+{
+#if defined(__aarch64__)
+        return vdivq_f32(a, b);
+#else
+        //ARMv7 has no vector divide, refine the reciprocal estimate twice
+        float32x4_t inv = vrecpeq_f32(b);
+        inv = vmulq_f32(inv, vrecpsq_f32(b, inv));
+        inv = vmulq_f32(inv, vrecpsq_f32(b, inv));
+        return vmulq_f32(a, inv);
+#endif
+}
+
+int lidar_decode_packet(const uint8_t *packet, size_t len, float *distance, float *angle)
+{
+        const float32x4_t k = vdupq_n_f32(LIDAR_CORR_K);
+        const float32x4_t k_d0 = vdupq_n_f32(LIDAR_CORR_K / LIDAR_CORR_D0);
+        const float32x4_t one = vdupq_n_f32(1);
+        const float32x4_t full = vdupq_n_f32(360);
+        const float32x4_t zero = vdupq_n_f32(0);
+        const float32x4_t lane = {0, 1, 2, 3};
+        float32x4_t d, x, ax, r, r2, p, a, fsa_v, step_v;
+        uint32x4_t big, valid;
+        float fsa, step;
+        int fsa_q6, diff_q6, i;
+        int lsn = lidar_decode_header(packet, len, &fsa_q6, &diff_q6, &fsa, &step);
+
+        if(lsn < 0)
+        {
+            return -1;
+        }
+        fsa_v = vdupq_n_f32(fsa);
+        step_v = vdupq_n_f32(step);
+        for(i = 0; i + 4 <= lsn; i += 4)
+        {
+            //Samples are only 2 byte aligned within the packet, load them as bytes
+            d = vcvtq_f32_u32(vmovl_u16(vreinterpret_u16_u8(vld1_u8(packet + YDLIDAR_HEADER_SIZE + 2 * i))));
+            d = vmulq_n_f32(d, 0.25f);
+            valid = vmvnq_u32(vceqq_f32(d, zero));
+            x = vsubq_f32(lidar_div_neon(k, d), k_d0);
+            ax = vabsq_f32(x);
+            big = vcgtq_f32(ax, one);
+            r = vbslq_f32(big, lidar_div_neon(one, ax), ax);
+            r2 = vmulq_f32(r, r);
+            p = vmlaq_f32(vdupq_n_f32(LIDAR_ATAN_C3), r2, vdupq_n_f32(LIDAR_ATAN_C4));
+            p = vmlaq_f32(vdupq_n_f32(LIDAR_ATAN_C2), r2, p);
+            p = vmlaq_f32(vdupq_n_f32(LIDAR_ATAN_C1), r2, p);
+            p = vmlaq_f32(vdupq_n_f32(LIDAR_ATAN_C0), r2, p);
+            p = vmulq_f32(r, p);
+            p = vbslq_f32(big, vsubq_f32(vdupq_n_f32(LIDAR_PI_2), p), p);
+            //Take the sign of x, then drop the correction for invalid samples (x is inf there)
+            p = vbslq_f32(vcltq_f32(x, zero), vnegq_f32(p), p);
+            p = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vmulq_n_f32(p, LIDAR_RAD_TO_DEG)), valid));
+            a = vaddq_f32(fsa_v, vmulq_f32(step_v, vaddq_f32(lane, vdupq_n_f32(i))));
+            a = vaddq_f32(a, p);
+            a = vsubq_f32(a, vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(a, full), vreinterpretq_u32_f32(full))));
+            a = vsubq_f32(a, vreinterpretq_f32_u32(vandq_u32(vcgeq_f32(a, full), vreinterpretq_u32_f32(full))));
+            a = vaddq_f32(a, vreinterpretq_f32_u32(vandq_u32(vcltq_f32(a, zero), vreinterpretq_u32_f32(full))));
+            vst1q_f32(distance + i, d);
+            vst1q_f32(angle + i, a);
+        }
+        lidar_decode_samples_fixed(packet, i, lsn, fsa_q6, diff_q6, distance, angle);
+        return lsn;
+}
+
+const char *lidar_decode_impl(void)
+{
+        return "neon";
+}
+
+#elif defined(LIDAR_DECODE_SSE2)
+
+int lidar_decode_packet(const uint8_t *packet, size_t len, float *distance, float *angle)
+{
+        const __m128 k = _mm_set1_ps(LIDAR_CORR_K);
+        const __m128 k_d0 = _mm_set1_ps(LIDAR_CORR_K / LIDAR_CORR_D0);
+        const __m128 one = _mm_set1_ps(1);
+        const __m128 full = _mm_set1_ps(360);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 sign = _mm_set1_ps(-0.0f);
+        const __m128 lane = _mm_setr_ps(0, 1, 2, 3);
+        __m128 d, x, ax, r, r2, p, a, big, fsa_v, step_v;
+        float fsa, step;
+        int fsa_q6, diff_q6, i;
+        int lsn = lidar_decode_header(packet, len, &fsa_q6, &diff_q6, &fsa, &step);
+
+        if(lsn < 0)
+        {
+            return -1;
+        }
+        fsa_v = _mm_set1_ps(fsa);
+        step_v = _mm_set1_ps(step);
+        for(i = 0; i + 4 <= lsn; i += 4)
+        {
+            d = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(packet + YDLIDAR_HEADER_SIZE + 2 * i)), _mm_setzero_si128()));
+            d = _mm_mul_ps(d, _mm_set1_ps(0.25f));
+            x = _mm_sub_ps(_mm_div_ps(k, d), k_d0);
+            ax = _mm_andnot_ps(sign, x);
+            big = _mm_cmpgt_ps(ax, one);
+            //SSE2 has no blend, select with and/andnot/or
+            r = _mm_or_ps(_mm_and_ps(big, _mm_div_ps(one, ax)), _mm_andnot_ps(big, ax));
+            r2 = _mm_mul_ps(r, r);
+            p = _mm_add_ps(_mm_set1_ps(LIDAR_ATAN_C3), _mm_mul_ps(r2, _mm_set1_ps(LIDAR_ATAN_C4)));
+            p = _mm_add_ps(_mm_set1_ps(LIDAR_ATAN_C2), _mm_mul_ps(r2, p));
+            p = _mm_add_ps(_mm_set1_ps(LIDAR_ATAN_C1), _mm_mul_ps(r2, p));
+            p = _mm_add_ps(_mm_set1_ps(LIDAR_ATAN_C0), _mm_mul_ps(r2, p));
+            p = _mm_mul_ps(r, p);
+            p = _mm_or_ps(_mm_and_ps(big, _mm_sub_ps(_mm_set1_ps(LIDAR_PI_2), p)), _mm_andnot_ps(big, p));
+            //Take the sign of x, then drop the correction for invalid samples (x is inf there)
+            p = _mm_or_ps(p, _mm_and_ps(sign, x));
+            p = _mm_and_ps(_mm_mul_ps(p, _mm_set1_ps(LIDAR_RAD_TO_DEG)), _mm_cmpneq_ps(d, zero));
+            a = _mm_add_ps(fsa_v, _mm_mul_ps(step_v, _mm_add_ps(lane, _mm_set1_ps((float)i))));
+            a = _mm_add_ps(a, p);
+            a = _mm_sub_ps(a, _mm_and_ps(_mm_cmpge_ps(a, full), full));
+            a = _mm_sub_ps(a, _mm_and_ps(_mm_cmpge_ps(a, full), full));
+            a = _mm_add_ps(a, _mm_and_ps(_mm_cmplt_ps(a, zero), full));
+            _mm_storeu_ps(distance + i, d);
+            _mm_storeu_ps(angle + i, a);
+        }
+        lidar_decode_samples_fixed(packet, i, lsn, fsa_q6, diff_q6, distance, angle);
+        return lsn;
+}
+
+const char *lidar_decode_impl(void)
+{
+        return "sse2";
+}
+
+#else
+
+int lidar_decode_packet(const uint8_t *packet, size_t len, float *distance, float *angle)
+{
+        float fsa, step;
+        int fsa_q6, diff_q6;
+        int lsn = lidar_decode_header(packet, len, &fsa_q6, &diff_q6, &fsa, &step);
+
+        if(lsn < 0)
+        {
+            return -1;
+        }
+        lidar_decode_samples_fixed(packet, 0, lsn, fsa_q6, diff_q6, distance, angle);
+        return lsn;
+}
+
+const char *lidar_decode_impl(void)
+{
+        return "fixed";
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef YDLIDAR_X4_DECODE_H
+#define YDLIDAR_X4_DECODE_H
+
+/*
+ * User space decoding of raw X4 scan packets into distances and corrected angles
+ * The whole packet is converted at once, 4 samples per step with NEON or SSE2 when the compiler targets them.
+ * Without either, and for the samples left over, the fixed point ydlidar_decode_points (ydlidar_x4_points.h) is used.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+//An X4 packet never carries more than 255 samples (LSN is a single byte)
+#define LIDAR_DECODE_MAX_POINTS 255
+
+/*
+ * @brief Decode one raw packet (AA 55 header included) with the fastest implementation built in
+ * @param distance Receives LSN distances in mm, 0 when the sample is invalid
+ * @param angle Receives LSN angles in degrees, interpolated between FSA and LSA, corrected and wrapped to [0, 360)
+ * @return LSN, or -1 if the packet is malformed
+ */
+int lidar_decode_packet(const uint8_t *packet, size_t len, float *distance, float *angle);
+
+//Name of the implementation behind lidar_decode_packet ("neon", "sse2" or "fixed")
+const char *lidar_decode_impl(void);
+
+#endif
@@ -9,8 +9,24 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 #include <linux/fs.h>
-#include <linux/semaphore.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
+#include <linux/kref.h>
+#include <linux/idr.h>
+#include <linux/sched/signal.h>
+#include <linux/vmalloc.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/timekeeping.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/pwm.h>
+
+#include "ydlidar_x4.h"
+#include "ydlidar_x4_points.h"
+#include "ydlidar_x4_parser.h"
 
 /* Meta Information */
 MODULE_LICENSE("GPL");
@@ -29,155 +45,824 @@ const unsigned char reboot_command[2]               = {0xA5,0x80};
 
 static dev_t my_device_nr;
 static struct class *my_class;
-static struct cdev my_device;
 
-static struct semaphore my_semaphore;
-static struct serdev_device *uartdev;
-//Boolean that states if buffer is ready to be read
-bool buffer_ready = false;
-//Boolean states if buffer is fragmented
-bool buffer_frag = false;
-//Int that keeps current offset written to buffer, used to write fragments to end of buffer
-int  buffer_size = 0;
-//Buffer that contains values
-char *my_buffer;
+//Nominal X4 sample rate is 5 kHz, used until a revolution has been measured
+#define LIDAR_DEFAULT_SAMPLE_PERIOD_NS 200000
+//Measured periods outside this range come from revolutions with lost packets or a stalled motor
+#define LIDAR_MIN_SAMPLE_PERIOD_NS 50000
+#define LIDAR_MAX_SAMPLE_PERIOD_NS 2000000
+#define LIDAR_MAX_PACKET_SIZE YDLIDAR_MAX_PACKET_SIZE
+//How long a command waits for its reply
+#define LIDAR_RESP_TIMEOUT_MS 1000
+//Scan frequency range of the X4 motor
+#define LIDAR_MIN_FREQ_MHZ 6000
+#define LIDAR_MAX_FREQ_MHZ 12000
+//Motor control loop: every 500 ms move the duty cycle by 2% of the PWM period per Hz of error
+#define LIDAR_FREQ_INTERVAL_MS 500
+#define LIDAR_FREQ_GAIN_PERMILLE_PER_HZ 20
+//Number of packet slots in the ring, must be a power of 2
+//~100 packets per revolution at 5 kHz, so this absorbs a few revolutions of reader stalls
+#define LIDAR_RING_SLOTS 512
+
 
-bool scan_mode = false;
+/*
+ * @brief Single producer / single consumer ring of complete scan packets
+ * head is only written by uart_driver_recv, tail is only written by the reader
+ * (readers are serialized by read_lock, or a single mmap consumer), so neither side needs a lock
+ * The whole ring can be mapped into user space, ctrl fills the first page and the slots follow
+ */
+struct lidar_ring {
+        struct ydlidar_ring_ctrl ctrl;
+        struct ydlidar_packet_slot slots[LIDAR_RING_SLOTS] __aligned(PAGE_SIZE);
+};
+
+/*
+ * @brief Link quality counters beyond the parser's, written only by the receive callback and exported through sysfs
+ */
+struct lidar_stats {
+        //Good packets dropped because the reader fell behind and the ring was full
+        unsigned long overflows;
+};
+
+/*
+ * @brief Receive side state, only touched by the receive callback
+ */
+struct lidar_rx {
+        struct ydlidar_parser parser;
+        //parser.resyncs when the last packet was seen, a change means packets may have been lost
+        unsigned long resyncs;
+        //Arrival of the last start of scan packet, 0 if the current revolution was disrupted
+        u64 scan_start_ns;
+        //Samples received since the last start of scan packet
+        u32 scan_samples;
+        //Smoothed time between samples
+        u32 sample_period_ns;
+        //Smoothed time per revolution, 0 until one has been measured
+        u32 scan_period_ns;
+};
+
+/*
+ * @brief State of one X4 on one UART, created by probe
+ * Freed when the serdev device is removed and the last open file is closed
+ */
+struct ydlidar {
+        struct kref ref;
+        //Protects serdev and scan_mode against remove and between commands
+        struct mutex lock;
+        //NULL once the serdev device has been removed
+        struct serdev_device *serdev;
+        struct cdev *cdev;
+        struct device *dev;
+        int minor;
+        bool scan_mode;
+        struct lidar_ring *ring;
+        struct lidar_stats stats;
+        //Serializes consumers of the ring, taken before lock and never while holding it
+        struct mutex read_lock;
+        //Readers sleep here until the receive callback queues a packet or scanning stops
+        wait_queue_head_t read_wait;
+        //YDLIDAR_FMT_* returned by read, set through SET_READ_FORMAT
+        unsigned int read_format;
+        //Decoded points for YDLIDAR_FMT_POINTS, protected by read_lock
+        struct ydlidar_point points_buf[255];
+        struct lidar_rx rx;
+        //Response descriptor type a command is waiting for, 0 if none
+        //Response descriptors are only looked for while this is set, scan samples can contain A5 5A
+        u8 resp_type;
+        //Payload of the last matching response, valid once resp_done completes
+        unsigned char resp[YDLIDAR_RESP_MAX_SIZE];
+        size_t resp_len;
+        struct completion resp_done;
+        //PWM driving M_CTR, NULL if the device tree does not provide one
+        struct pwm_device *motor_pwm;
+        //Scan frequency regulated by freq_work, 0 if not regulating, protected by lock
+        u32 target_mhz;
+        struct delayed_work freq_work;
+};
 
 #define DRIVER_NAME "my_uart_driver"
 #define DRIVER_CLASS "UartClass"
+//Character device minors available to X4 units
+#define LIDAR_MAX_DEVICES 4
 
-#define START_IOC_MAGIC 'Z'
-#define SEND_START_COMMAND _IOW(START_IOC_MAGIC, 1, unsigned long)
+static DEFINE_IDA(lidar_minors);
+//Maps a minor to its device for open, protected by lidar_devices_lock
+static struct ydlidar *lidar_devices[LIDAR_MAX_DEVICES];
+static DEFINE_MUTEX(lidar_devices_lock);
 
-#define STOP_IOC_MAGIC 'Y'
-#define SEND_STOP_COMMAND _IOW(STOP_IOC_MAGIC, 1, unsigned long)
+static struct ydlidar_packet_slot *lidar_ring_slot(struct lidar_ring *r, unsigned int idx)
+{
+        return &r->slots[idx & (LIDAR_RING_SLOTS - 1)];
+}
+
+/*
+ * @brief Snapshot of tail, which is writable through mmap and so never used unchecked
+ * A tail more than LIDAR_RING_SLOTS behind head (or ahead of it) can only come from a broken consumer.
+ * @return false if the snapshot is invalid
+ */
+static bool lidar_ring_tail_valid(struct lidar_ring *r, unsigned int head, unsigned int *tail)
+{
+        //Pairs with the release of whoever moved tail last, slots before it are free
+        *tail = smp_load_acquire(&r->ctrl.tail);
+        return head - *tail <= LIDAR_RING_SLOTS;
+}
+
+/*
+ * @brief Checked tail for the consumer, caller must hold read_lock
+ * An invalid tail is reset to head, dropping whatever was queued, so no loop walks 2^32 slots and push
+ * does not see a full ring forever. Only the consumer writes tail, the producer never does.
+ */
+static unsigned int lidar_ring_tail(struct lidar_ring *r, unsigned int head)
+{
+        unsigned int tail;
+
+        if(!lidar_ring_tail_valid(r, head, &tail))
+        {
+            pr_warn_ratelimited("ydlidar_x4 - Warning, invalid ring tail %u (head %u), discarding queued packets!", tail, head);
+            smp_store_release(&r->ctrl.tail, head);
+            tail = head;
+        }
+        return tail;
+}
 
-#define INFO_IOC_MAGIC 'X'
-#define SEND_INFO_COMMAND _IOW(INFO_IOC_MAGIC, 1, unsigned long)
+/*
+ * @brief Queue a complete packet, called only from the receive callback
+ * @return false if the ring is full and the packet was dropped
+ */
+static bool lidar_ring_push(struct ydlidar *lidar, const unsigned char *data, size_t len, u64 timestamp_ns, u32 sample_period_ns)
+{
+        struct lidar_ring *r = lidar->ring;
+        unsigned int head = r->ctrl.head;
+        struct ydlidar_packet_slot *slot;
+        unsigned int tail;
+
+        //Slot is free once tail has moved past it, a ring with an invalid tail counts as full until a reader resets it
+        if(!lidar_ring_tail_valid(r, head, &tail) || head - tail >= LIDAR_RING_SLOTS)
+        {
+            WRITE_ONCE(lidar->stats.overflows, lidar->stats.overflows + 1);
+            pr_warn_ratelimited("ydlidar_x4 - Warning, packet ring full, %lu packets dropped!", lidar->stats.overflows);
+            return false;
+        }
+        slot = lidar_ring_slot(r, head);
+        memcpy(slot->data, data, len);
+        slot->len = len;
+        slot->timestamp_ns = timestamp_ns;
+        slot->sample_period_ns = sample_period_ns;
+        //Publish the slot contents before the new head
+        smp_store_release(&r->ctrl.head, head + 1);
+        return true;
+}
+
+/*
+ * @brief True if at least one packet is queued, safe to call without read_lock
+ * An invalid tail also reads as ready, the next read resets it
+ */
+static bool lidar_ring_ready(struct lidar_ring *r)
+{
+        return smp_load_acquire(&r->ctrl.head) != READ_ONCE(r->ctrl.tail);
+}
+
+static bool lidar_packet_starts_scan(const struct ydlidar_packet_slot *packet)
+{
+        return packet->data[YDLIDAR_CT_OFFSET] & YDLIDAR_CT_START_BM;
+}
+
+/*
+ * @brief Locate the oldest complete revolution (start of scan packet up to the next one) between tail and head
+ * @param start Receives the first start of scan slot at or after tail, head if there is none
+ * @return Packets in the revolution, 0 while it is still arriving
+ */
+static unsigned int lidar_ring_scan(struct lidar_ring *r, unsigned int tail, unsigned int head, unsigned int *start)
+{
+        unsigned int idx = tail;
+
+        //Packets ahead of the first start of scan marker belong to a revolution we only saw part of
+        while(idx != head && !lidar_packet_starts_scan(lidar_ring_slot(r, idx)))
+        {
+            idx++;
+        }
+        *start = idx;
+        if(idx == head)
+        {
+            return 0;
+        }
+        for(idx++; idx != head; idx++)
+        {
+            if(lidar_packet_starts_scan(lidar_ring_slot(r, idx)))
+            {
+                return idx - *start;
+            }
+        }
+        return 0;
+}
+
+/*
+ * @brief Oldest queued packet or NULL if the ring is empty, caller must hold read_lock
+ */
+static struct ydlidar_packet_slot *lidar_ring_peek(struct lidar_ring *r)
+{
+        unsigned int head = smp_load_acquire(&r->ctrl.head);
+        unsigned int tail = lidar_ring_tail(r, head);
+
+        if(head == tail)
+        {
+            return NULL;
+        }
+        return lidar_ring_slot(r, tail);
+}
+
+/*
+ * @brief Hand the slot returned by lidar_ring_peek back to the producer
+ */
+static void lidar_ring_consume(struct lidar_ring *r)
+{
+        smp_store_release(&r->ctrl.tail, READ_ONCE(r->ctrl.tail) + 1);
+}
+
+/*
+ * @brief Discard everything queued, caller must hold read_lock
+ */
+static void lidar_ring_flush(struct lidar_ring *r)
+{
+        smp_store_release(&r->ctrl.tail, smp_load_acquire(&r->ctrl.head));
+}
+
+/*
+ * @brief Send a command and wait for its response payload, caller must hold lock
+ * @param type Response descriptor type the command is answered with
+ * @param len Expected payload length
+ * @return 0 once lidar->resp holds the payload, negative error otherwise
+ */
+static int lidar_command(struct ydlidar *lidar, const unsigned char *command, u8 type, size_t len)
+{
+        long left;
+
+        //Replies are not sent, or would be lost among the samples, while scanning
+        if(READ_ONCE(lidar->scan_mode))
+        {
+            return -EBUSY;
+        }
+        reinit_completion(&lidar->resp_done);
+        //Parser must be looking for the descriptor before the reply can arrive
+        smp_store_release(&lidar->resp_type, type);
+        serdev_device_write_buf(lidar->serdev, command, 2);
+        left = wait_for_completion_interruptible_timeout(&lidar->resp_done, msecs_to_jiffies(LIDAR_RESP_TIMEOUT_MS));
+        WRITE_ONCE(lidar->resp_type, 0);
+        if(left < 0)
+        {
+            return left;
+        }
+        if(left == 0)
+        {
+            pr_err("ydlidar_x4_driver - No response to command 0x%02x", command[1]);
+            return -ETIMEDOUT;
+        }
+        if(lidar->resp_len != len)
+        {
+            pr_err("ydlidar_x4_driver - Response to command 0x%02x has %zu bytes, expected %zu", command[1], lidar->resp_len, len);
+            return -EIO;
+        }
+        return 0;
+}
+
+static int lidar_get_device_info(struct ydlidar *lidar, struct ydlidar_device_info *info)
+{
+        int ret = lidar_command(lidar, device_info_command, YDLIDAR_RESP_TYPE_INFO, YDLIDAR_RESP_INFO_SIZE);
+
+        if(ret)
+        {
+            return ret;
+        }
+        //model, firmware (16 bit little endian, major in the high byte), hardware, serial
+        info->model = lidar->resp[0];
+        info->firmware_minor = lidar->resp[1];
+        info->firmware_major = lidar->resp[2];
+        info->hardware = lidar->resp[3];
+        memcpy(info->serial, lidar->resp + 4, sizeof(info->serial));
+        return 0;
+}
+
+static int lidar_get_health(struct ydlidar *lidar, struct ydlidar_health *health)
+{
+        int ret = lidar_command(lidar, health_status_command, YDLIDAR_RESP_TYPE_HEALTH, YDLIDAR_RESP_HEALTH_SIZE);
+
+        if(ret)
+        {
+            return ret;
+        }
+        //status, error code (16 bit little endian)
+        health->status = lidar->resp[0];
+        health->reserved = 0;
+        health->error_code = lidar->resp[1] | (lidar->resp[2] << 8);
+        return 0;
+}
+
+/*
+ * @brief Scan frequency measured from the revolution time, 0 if not scanning or not measured yet
+ */
+static u32 lidar_measured_mhz(struct ydlidar *lidar)
+{
+        u32 scan_period_ns = READ_ONCE(lidar->rx.scan_period_ns);
+
+        if(!READ_ONCE(lidar->scan_mode) || !scan_period_ns)
+        {
+            return 0;
+        }
+        return div_u64(1000 * NSEC_PER_SEC, scan_period_ns);
+}
+
+/*
+ * @brief Make sure the motor PWM is running before regulating it, starting at 50% if it was off
+ */
+static int lidar_motor_start(struct ydlidar *lidar)
+{
+        struct pwm_state state;
 
-#define STATUS_IOC_MAGIC 'W'
-#define SEND_STATUS_COMMAND _IOW(STATUS_IOC_MAGIC, 1, unsigned long)
+        pwm_get_state(lidar->motor_pwm, &state);
+        if(state.enabled)
+        {
+            return 0;
+        }
+        //Period and polarity from the pwms specifier
+        pwm_init_state(lidar->motor_pwm, &state);
+        pwm_set_relative_duty_cycle(&state, 50, 100);
+        state.enabled = true;
+        return pwm_apply_state(lidar->motor_pwm, &state);
+}
 
-#define REBOOT_IOC_MAGIC 'V'
-#define SEND_REBOOT_COMMAND _IOW(REBOOT_IOC_MAGIC, 1, unsigned long)
+/*
+ * @brief Proportional control of the M_CTR duty cycle towards target_mhz, reschedules itself while regulating
+ */
+static void lidar_freq_work(struct work_struct *work)
+{
+        struct ydlidar *lidar = container_of(to_delayed_work(work), struct ydlidar, freq_work);
+        struct pwm_state state;
+        s64 duty, error_mhz;
+        u32 measured;
 
-#define MODE_IOC_MAGIC 'U'
-#define CURRENT_MODE _IOW(MODE_IOC_MAGIC, 1, unsigned long)
+        mutex_lock(&lidar->lock);
+        if(!lidar->serdev || !lidar->target_mhz)
+        {
+            mutex_unlock(&lidar->lock);
+            return;
+        }
+        //Nothing to regulate against until a revolution has been measured
+        measured = lidar_measured_mhz(lidar);
+        if(measured)
+        {
+            pwm_get_state(lidar->motor_pwm, &state);
+            error_mhz = (s64)lidar->target_mhz - measured;
+            duty = state.duty_cycle + div_s64(error_mhz * (s64)state.period * LIDAR_FREQ_GAIN_PERMILLE_PER_HZ, 1000 * 1000);
+            state.duty_cycle = clamp_t(s64, duty, 0, state.period);
+            if(pwm_apply_state(lidar->motor_pwm, &state))
+            {
+                pr_warn_ratelimited("ydlidar_x4_driver - Warning, could not update motor PWM!");
+            }
+        }
+        schedule_delayed_work(&lidar->freq_work, msecs_to_jiffies(LIDAR_FREQ_INTERVAL_MS));
+        mutex_unlock(&lidar->lock);
+}
 
 long driver_ioctl (struct file *file, unsigned int cmd, unsigned long arg)
 {
+        struct ydlidar_device_info info;
+        struct ydlidar_health health;
+        struct ydlidar_scan_frequency freq;
+        struct ydlidar *lidar = file->private_data;
+        bool read_locked = false;
+        long ret;
+
         if (!file->f_path.dentry->d_inode) {
             // Handle the case where the user space program has closed
             return -EINVAL;
         }
-        if(!uartdev)
+        //A reader can sleep holding read_lock, wait for it before lock so STOP is never held up behind it
+        if(cmd == SEND_START_COMMAND || cmd == SET_READ_FORMAT)
+        {
+            if(file->f_flags & O_NONBLOCK)
+            {
+                if(!mutex_trylock(&lidar->read_lock))
+                {
+                    return -EAGAIN;
+                }
+            }
+            else if(mutex_lock_interruptible(&lidar->read_lock))
+            {
+                return -ERESTARTSYS;
+            }
+            read_locked = true;
+        }
+        mutex_lock(&lidar->lock);
+        if(!lidar->serdev)
         {
             pr_err("ydlidar_x4_driver - uartdev is invalid");
-            return -EINVAL;
+            ret = -ENODEV;
+            goto out;
         }
 
 	if (cmd == SEND_START_COMMAND) {
-            scan_mode = true;
-            serdev_device_write_buf(uartdev, start_scan_mode_command, 2);
+            //Drop packets left over from a previous scan
+            lidar_ring_flush(lidar->ring);
+            //Do not report the last scan's frequency until this one has been measured
+            WRITE_ONCE(lidar->rx.scan_period_ns, 0);
+            WRITE_ONCE(lidar->scan_mode, true);
+            serdev_device_write_buf(lidar->serdev, start_scan_mode_command, 2);
             pr_info("ydlidar_x4_driver - Start scan mode command");
-            return 1;
+            ret = 1;
 	}
 	else if (cmd == SEND_STOP_COMMAND) {
-            scan_mode = false;
-            serdev_device_write_buf(uartdev, stop_scan_mode_command, 2);
+            WRITE_ONCE(lidar->scan_mode, false);
+            //Blocked readers return once scanning stops
+            wake_up_interruptible(&lidar->read_wait);
+            serdev_device_write_buf(lidar->serdev, stop_scan_mode_command, 2);
             pr_info("ydlidar_x4_driver - Stop scan mode command");
-            return 1;
+            ret = 1;
 	}
 	else if (cmd == SEND_INFO_COMMAND) {
-            serdev_device_write_buf(uartdev, device_info_command, 2);
-            pr_info("ydlidar_x4_driver - Device info command");
-            return 1;
+            ret = lidar_get_device_info(lidar, &info);
+            if(ret)
+            {
+                goto out;
+            }
+            pr_info("ydlidar_x4_driver - Device info command, model %u firmware %u.%u hardware %u",
+                    info.model, info.firmware_major, info.firmware_minor, info.hardware);
+            ret = 1;
 	}
 	else if (cmd == SEND_STATUS_COMMAND) {
-            serdev_device_write_buf(uartdev, health_status_command, 2);
-            pr_info("ydlidar_x4_driver - Health status command");
-            return 1;
+            ret = lidar_get_health(lidar, &health);
+            if(ret)
+            {
+                goto out;
+            }
+            pr_info("ydlidar_x4_driver - Health status command, status %u error code 0x%04x", health.status, health.error_code);
+            ret = 1;
+	}
+	else if (cmd == GET_DEVICE_INFO) {
+            ret = lidar_get_device_info(lidar, &info);
+            if(!ret && copy_to_user((void __user *)arg, &info, sizeof(info)))
+            {
+                ret = -EFAULT;
+            }
+	}
+	else if (cmd == GET_HEALTH) {
+            ret = lidar_get_health(lidar, &health);
+            if(!ret && copy_to_user((void __user *)arg, &health, sizeof(health)))
+            {
+                ret = -EFAULT;
+            }
+	}
+	else if (cmd == GET_SCAN_FREQUENCY) {
+            freq.measured_mhz = lidar_measured_mhz(lidar);
+            freq.target_mhz = lidar->target_mhz;
+            ret = 0;
+            if(copy_to_user((void __user *)arg, &freq, sizeof(freq)))
+            {
+                ret = -EFAULT;
+            }
+	}
+	else if (cmd == SET_SCAN_FREQUENCY) {
+            //The X4 has no frequency command, only the motor voltage on M_CTR sets the speed
+            if(!lidar->motor_pwm)
+            {
+                pr_err("ydlidar_x4_driver - No motor PWM, scan frequency can not be set");
+                ret = -EOPNOTSUPP;
+                goto out;
+            }
+            if(arg && (arg < LIDAR_MIN_FREQ_MHZ || arg > LIDAR_MAX_FREQ_MHZ))
+            {
+                pr_err("ydlidar_x4_driver - Scan frequency %lu mHz out of range", arg);
+                ret = -EINVAL;
+                goto out;
+            }
+            if(arg)
+            {
+                ret = lidar_motor_start(lidar);
+                if(ret)
+                {
+                    goto out;
+                }
+                mod_delayed_work(system_wq, &lidar->freq_work, 0);
+            }
+            //Loop stops on its next run once the target is 0, the duty cycle is left where it was
+            lidar->target_mhz = arg;
+            pr_info("ydlidar_x4_driver - Scan frequency target %lu mHz", arg);
+            ret = 0;
 	}
 	else if (cmd == SEND_REBOOT_COMMAND) {
-            serdev_device_write_buf(uartdev, reboot_command, 2);
+            serdev_device_write_buf(lidar->serdev, reboot_command, 2);
             pr_info("ydlidar_x4_driver - Reboot command");
-            scan_mode = false;
-            return 1;
+            WRITE_ONCE(lidar->scan_mode, false);
+            wake_up_interruptible(&lidar->read_wait);
+            ret = 1;
+	}
+	else if (cmd == SET_READ_FORMAT) {
+            if(arg != YDLIDAR_FMT_PACKET && arg != YDLIDAR_FMT_SCAN &&
+               arg != YDLIDAR_FMT_POINTS && arg != YDLIDAR_FMT_PACKET_TS)
+            {
+                pr_err("ydlidar_x4_driver - Unsupported read format %lu", arg);
+                ret = -EINVAL;
+                goto out;
+            }
+            //Switched under read_lock so a reader never sees half of each format
+            WRITE_ONCE(lidar->read_format, arg);
+            pr_info("ydlidar_x4_driver - Read format %lu", arg);
+            ret = 1;
 	}
 	else if (cmd == CURRENT_MODE) {
-            if(scan_mode){
+            if(lidar->scan_mode){
                 pr_info("ydlidar_x4_driver - Scan mode");
-                return 1;
+                ret = 1;
             }
             else{
                 pr_info("ydlidar_x4_driver - Stop mode");
-                return 0;
+                ret = 0;
             }
 	}
-        pr_err("ydlidar_x4_driver - No supported command issued");
-	return -1;
+        else {
+            pr_err("ydlidar_x4_driver - No supported command issued");
+	    ret = -1;
+        }
+out:
+        mutex_unlock(&lidar->lock);
+        if(read_locked)
+        {
+            mutex_unlock(&lidar->read_lock);
+        }
+        return ret;
 }
 
-static ssize_t driver_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
-        //return my_buffer to users space
-        int attempts = 10;
-        while (1) {
-            // Attempt to acquire the semaphore
-            if(attempts == 0)
+/*
+ * @brief Wait until the receive callback queues a packet past seen_head, caller must hold read_lock
+ * @return 0 once new packets may be available, negative error otherwise
+ */
+static int lidar_wait_for_packets(struct ydlidar *lidar, struct file *filp, unsigned int seen_head)
+{
+        struct lidar_ring *ring = lidar->ring;
+
+        if(!READ_ONCE(lidar->serdev))
+        {
+            return -ENODEV;
+        }
+        if(!READ_ONCE(lidar->scan_mode))
+        {
+	    pr_err_ratelimited("ydlidar_x4 - Error, not in scan mode!");
+            return -EINVAL;
+        }
+        if(smp_load_acquire(&ring->ctrl.head) != seen_head)
+        {
+            return 0;
+        }
+        if(filp->f_flags & O_NONBLOCK)
+        {
+            return -EAGAIN;
+        }
+        //Sleep until the receive callback queues a packet or scanning stops
+        if(wait_event_interruptible(lidar->read_wait, smp_load_acquire(&ring->ctrl.head) != seen_head || !READ_ONCE(lidar->scan_mode)))
+        {
+            return -ERESTARTSYS;
+        }
+        return 0;
+}
+
+/*
+ * @brief Length of a queued packet, slots are writable through mmap so never trust it past the slot size
+ */
+static size_t lidar_packet_len(const struct ydlidar_packet_slot *packet)
+{
+        return min_t(size_t, READ_ONCE(packet->len), LIDAR_MAX_PACKET_SIZE);
+}
+
+/*
+ * @brief Wait for the oldest queued packet, caller must hold read_lock
+ * @return The packet, still queued, or an ERR_PTR
+ */
+static struct ydlidar_packet_slot *lidar_next_packet(struct ydlidar *lidar, struct file *filp)
+{
+        struct ydlidar_packet_slot *packet;
+        int ret;
+
+        while(!(packet = lidar_ring_peek(lidar->ring)))
+        {
+            ret = lidar_wait_for_packets(lidar, filp, READ_ONCE(lidar->ring->ctrl.tail));
+            if(ret)
             {
-	        pr_err("ydlidar_x4 - Error, unable to aquire semaphore!");
-                return -EINVAL;
+                return ERR_PTR(ret);
             }
-            if (down_interruptible(&my_semaphore)) {
-                //Failed to acquire semaphore, retry
-                attempts--;
-                continue;
-            }
-            if (!filp->f_path.dentry->d_inode) {
-	        pr_err("ydlidar_x4 - User space program has been closed!");
-                // Handle the case where the user space program has closed
-                up(&my_semaphore);
-                return -EINVAL;
+        }
+        return packet;
+}
+
+/*
+ * @brief YDLIDAR_FMT_PACKET and YDLIDAR_FMT_PACKET_TS, copy the oldest packet to user space
+ * @param with_header Prefix the packet with struct ydlidar_packet_header
+ */
+static ssize_t lidar_read_packet(struct ydlidar *lidar, struct file *filp, char __user *buf, size_t count, bool with_header)
+{
+        struct ydlidar_packet_header hdr;
+        struct ydlidar_packet_slot *packet;
+        size_t len, offset = 0;
+
+        packet = lidar_next_packet(lidar, filp);
+        if(IS_ERR(packet))
+        {
+            return PTR_ERR(packet);
+        }
+        len = lidar_packet_len(packet);
+        if(with_header)
+        {
+            offset = sizeof(hdr);
+        }
+        if(count < offset + len)
+        {
+	    pr_err("ydlidar_x4 - Error, user buffer too small for %zu byte packet!", offset + len);
+            return -EINVAL;
+        }
+        if(with_header)
+        {
+            hdr.timestamp_ns = packet->timestamp_ns;
+            hdr.sample_period_ns = packet->sample_period_ns;
+            hdr.length = len;
+            if(copy_to_user(buf, &hdr, sizeof(hdr)))
+            {
+	        pr_err("ydlidar_x4 - Error, Failed to copy to user buffer!");
+                return -EFAULT;
             }
-            if(!my_buffer)
+        }
+        if(copy_to_user(buf + offset, packet->data, len))
+        {
+	    pr_err("ydlidar_x4 - Error, Failed to copy to user buffer!");
+            return -EFAULT;
+        }
+        //Packet has been read, release the slot so that this old data is not read again
+        lidar_ring_consume(lidar->ring);
+        return offset + len;
+}
+
+/*
+ * @brief YDLIDAR_FMT_POINTS, decode the oldest packet into corrected (distance, angle) points
+ */
+static ssize_t lidar_read_points(struct ydlidar *lidar, struct file *filp, char __user *buf, size_t count)
+{
+        struct ydlidar_points_header hdr;
+        struct ydlidar_packet_slot *packet;
+        size_t len;
+        int points;
+
+        packet = lidar_next_packet(lidar, filp);
+        if(IS_ERR(packet))
+        {
+            return PTR_ERR(packet);
+        }
+        points = ydlidar_decode_points(packet->data, lidar_packet_len(packet), lidar->points_buf);
+        if(points < 0)
+        {
+            //Only possible if the slot was scribbled on through mmap
+	    pr_err("ydlidar_x4 - Error, malformed packet in ring!");
+            lidar_ring_consume(lidar->ring);
+            return -EIO;
+        }
+        len = sizeof(hdr) + points * sizeof(lidar->points_buf[0]);
+        if(count < len)
+        {
+	    pr_err("ydlidar_x4 - Error, user buffer too small for %zu byte point set!", len);
+            return -EINVAL;
+        }
+        memset(&hdr, 0, sizeof(hdr));
+        hdr.timestamp_ns = packet->timestamp_ns;
+        hdr.sample_period_ns = packet->sample_period_ns;
+        hdr.count = points;
+        if(lidar_packet_starts_scan(packet))
+        {
+            hdr.flags |= YDLIDAR_POINTS_START_OF_SCAN;
+        }
+        if(copy_to_user(buf, &hdr, sizeof(hdr)) ||
+           copy_to_user(buf + sizeof(hdr), lidar->points_buf, points * sizeof(lidar->points_buf[0])))
+        {
+	    pr_err("ydlidar_x4 - Error, Failed to copy to user buffer!");
+            return -EFAULT;
+        }
+        lidar_ring_consume(lidar->ring);
+        return len;
+}
+
+/*
+ * @brief YDLIDAR_FMT_SCAN, copy one complete revolution (start of scan packet up to the next one) to user space
+ * The revolution stays queued until the next start of scan packet arrives, so a scan is never delivered torn
+ */
+static ssize_t lidar_read_scan(struct ydlidar *lidar, struct file *filp, char __user *buf, size_t count)
+{
+        struct lidar_ring *ring = lidar->ring;
+        struct ydlidar_scan_header hdr;
+        struct ydlidar_packet_slot *packet;
+        unsigned int head, tail, start, packets, idx;
+        size_t offset;
+        int ret;
+
+        while(1)
+        {
+            head = smp_load_acquire(&ring->ctrl.head);
+            //tail is mapped into user space, work on a checked snapshot of it
+            tail = lidar_ring_tail(ring, head);
+            packets = lidar_ring_scan(ring, tail, head, &start);
+            //Drop the partial revolution ahead of the first start of scan marker
+            if(start != tail)
             {
-	        pr_err("ydlidar_x4 - Kernel Space Buffer is invalid!");
-                up(&my_semaphore);
-                return -EINVAL;
+                tail = start;
+                smp_store_release(&ring->ctrl.tail, tail);
             }
-            if(!buf)
+            if(packets)
             {
-	        pr_err("ydlidar_x4 - User Space Buffer is invalid!");
-                up(&my_semaphore);
-                return -EINVAL;
+                break;
             }
-            if(!scan_mode)
+            if(head - tail >= LIDAR_RING_SLOTS)
             {
-	        pr_err("ydlidar_x4 - Error, not in scan mode!");
-                up(&my_semaphore);
-                return -EINVAL;
+                //Ring filled without a second marker, the revolution can never complete
+                pr_warn_ratelimited("ydlidar_x4 - Warning, no start of scan marker in a full ring, dropping %u packets!", LIDAR_RING_SLOTS);
+                smp_store_release(&ring->ctrl.tail, head);
             }
-
-            if(!buffer_ready)
+            ret = lidar_wait_for_packets(lidar, filp, head);
+            if(ret)
             {
-                //buffer isn't ready, release semaphore and try again
-                up(&my_semaphore);
-                continue;
+                return ret;
             }
-            //Semaphore acquired
-            break;
         }
-        if(copy_to_user(buf, my_buffer, 500))
+        memset(&hdr, 0, sizeof(hdr));
+        for(idx = tail; idx != tail + packets; idx++)
+        {
+            packet = lidar_ring_slot(ring, idx);
+            hdr.length += lidar_packet_len(packet);
+            hdr.sample_count += packet->data[YDLIDAR_LSN_OFFSET];
+        }
+        hdr.packet_count = packets;
+        if(count < sizeof(hdr) + hdr.length)
+        {
+	    pr_err("ydlidar_x4 - Error, user buffer too small for %zu byte scan!", sizeof(hdr) + hdr.length);
+            return -EINVAL;
+        }
+        hdr.timestamp_ns = lidar_ring_slot(ring, tail)->timestamp_ns;
+        hdr.sample_period_ns = lidar_ring_slot(ring, tail)->sample_period_ns;
+        if(copy_to_user(buf, &hdr, sizeof(hdr)))
         {
 	    pr_err("ydlidar_x4 - Error, Failed to copy to user buffer!");
-            up(&my_semaphore);
+            return -EFAULT;
+        }
+        offset = sizeof(hdr);
+        for(idx = tail; idx != tail + hdr.packet_count; idx++)
+        {
+            packet = lidar_ring_slot(ring, idx);
+            if(copy_to_user(buf + offset, packet->data, lidar_packet_len(packet)))
+            {
+	        pr_err("ydlidar_x4 - Error, Failed to copy to user buffer!");
+                return -EFAULT;
+            }
+            offset += lidar_packet_len(packet);
+        }
+        //Whole revolution has been read, release its slots
+        smp_store_release(&ring->ctrl.tail, tail + hdr.packet_count);
+        return offset;
+}
+
+/*
+ * @brief Return queued lidar data to user space in the selected read format
+ * @return Number of bytes copied (one packet or one revolution per read)
+ */
+static ssize_t driver_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+        struct ydlidar *lidar = filp->private_data;
+        ssize_t ret;
+
+        if (!filp->f_path.dentry->d_inode) {
+	    pr_err("ydlidar_x4 - User space program has been closed!");
             return -EINVAL;
         }
-        //Buffer data has been read, set flag so that this old data is not read again
-        buffer_ready = false;
-        up(&my_semaphore);
-	return 0;
+        if(!buf)
+        {
+	    pr_err("ydlidar_x4 - User Space Buffer is invalid!");
+            return -EINVAL;
+        }
+        if(filp->f_flags & O_NONBLOCK)
+        {
+            if(!mutex_trylock(&lidar->read_lock))
+            {
+                return -EAGAIN;
+            }
+        }
+        else if (mutex_lock_interruptible(&lidar->read_lock)) {
+            return -ERESTARTSYS;
+        }
+        if(lidar->read_format == YDLIDAR_FMT_SCAN)
+        {
+            ret = lidar_read_scan(lidar, filp, buf, count);
+        }
+        else if(lidar->read_format == YDLIDAR_FMT_POINTS)
+        {
+            ret = lidar_read_points(lidar, filp, buf, count);
+        }
+        else
+        {
+            ret = lidar_read_packet(lidar, filp, buf, count, lidar->read_format == YDLIDAR_FMT_PACKET_TS);
+        }
+        mutex_unlock(&lidar->read_lock);
+	return ret;
 }
 
 //Device driver will eventually be writen for the YDLIDAR X4
@@ -197,6 +882,100 @@ static struct serdev_device_driver uart_driver_driver = {
 	},
 };
 
+/*
+ * @brief Track the sample period from the time between start of scan packets, called for every good packet
+ */
+static void lidar_rx_update_period(struct lidar_rx *p, const unsigned char *frame, u64 timestamp_ns)
+{
+        u64 period;
+
+        if(frame[YDLIDAR_CT_OFFSET] & YDLIDAR_CT_START_BM)
+        {
+            if(p->scan_start_ns && p->scan_samples && timestamp_ns > p->scan_start_ns)
+            {
+                period = div_u64(timestamp_ns - p->scan_start_ns, p->scan_samples);
+                if(period >= LIDAR_MIN_SAMPLE_PERIOD_NS && period <= LIDAR_MAX_SAMPLE_PERIOD_NS)
+                {
+                    //Smooth over ~8 revolutions
+                    p->sample_period_ns = p->sample_period_ns - p->sample_period_ns / 8 + (u32)period / 8;
+                    //Same revolution gives the scan frequency, smoothed over only ~4 so the motor control loop sees changes quickly
+                    period = timestamp_ns - p->scan_start_ns;
+                    if(!p->scan_period_ns)
+                    {
+                        WRITE_ONCE(p->scan_period_ns, (u32)period);
+                    }
+                    else
+                    {
+                        WRITE_ONCE(p->scan_period_ns, p->scan_period_ns - p->scan_period_ns / 4 + (u32)period / 4);
+                    }
+                }
+            }
+            p->scan_start_ns = timestamp_ns;
+            p->scan_samples = 0;
+        }
+        p->scan_samples += frame[YDLIDAR_LSN_OFFSET];
+}
+
+/*
+ * @brief Hand a completed response to the waiting command
+ */
+static void lidar_rx_response(struct ydlidar *lidar, const unsigned char *frame, size_t len)
+{
+        //Command may have timed out while the payload was arriving
+        if(READ_ONCE(lidar->resp_type) == frame[YDLIDAR_RESP_TYPE_OFFSET])
+        {
+            memcpy(lidar->resp, frame + YDLIDAR_RESP_DESC_SIZE, len - YDLIDAR_RESP_DESC_SIZE);
+            lidar->resp_len = len - YDLIDAR_RESP_DESC_SIZE;
+            WRITE_ONCE(lidar->resp_type, 0);
+            complete(&lidar->resp_done);
+        }
+}
+
+/*
+ * @brief Feed received bytes through the packet parser, queuing every completed frame
+ */
+static void lidar_rx_feed(struct ydlidar *lidar, const unsigned char *buffer, size_t size, u64 now_ns)
+{
+        struct lidar_rx *rx = &lidar->rx;
+        struct ydlidar_parser *p = &rx->parser;
+        size_t consumed;
+        bool queued = false;
+
+        //Pairs with the release in lidar_command
+        p->resp_type = smp_load_acquire(&lidar->resp_type);
+        while(size)
+        {
+            switch(ydlidar_parse(p, buffer, size, now_ns, &consumed))
+            {
+            case YDLIDAR_PARSE_PACKET:
+                if(p->resyncs != rx->resyncs)
+                {
+                    //Packets may have been lost, do not measure this revolution
+                    rx->resyncs = p->resyncs;
+                    rx->scan_start_ns = 0;
+                }
+                lidar_rx_update_period(rx, p->frame, p->timestamp_ns);
+                if(lidar_ring_push(lidar, p->frame, p->len, p->timestamp_ns, rx->sample_period_ns))
+                {
+                    queued = true;
+                }
+                break;
+            case YDLIDAR_PARSE_RESPONSE:
+                lidar_rx_response(lidar, p->frame, p->len);
+                break;
+            case YDLIDAR_PARSE_MORE:
+                break;
+            }
+            buffer += consumed;
+            size -= consumed;
+        }
+        //One wake up per callback no matter how many packets it carried
+        if(queued)
+        {
+            wake_up_interruptible(&lidar->read_wait);
+        }
+}
+
 /**
  * @brief Callback is called whenever a character is received
  */
@@ -212,80 +991,8 @@ static int uart_driver_recv(struct serdev_device *serdev, const unsigned char *b
             pr_err("ydlidar_x4 - Error, invalid buffer!");
             return -EINVAL;
          }
-         if (down_interruptible(&my_semaphore)) {
-             if(size > 500)
-             {
-                 pr_warn("ydlidar_x4 - Warning, UART buffer cleared!");
-                 return size;
-             }
-             //Failed to aquire semaphore
-             return 0;
-         }
-         //printk("\nHeader values %x%x",buffer[0],buffer[1]);
-         //Semaphore acquired
-         //printk("Uart Buffer Size %ld\n", size);
-         //for(int x = 0; x < size; x++)
-         //{
-         //    pr_info("%x\n",buffer[x]);
-         //}
-         //TO:DO check header and check size, if buffer doesn't have complete packet make next write to buffer and do not memset
-         if(size < 3 || size > 500)
-         {
-             goto InvalidBuf;
-         }
-         if(buffer[0] == 0xAA && buffer[1] == 0x55)
-         {
-             //Account for 10 byte header and 16 bit words
-             int uart_buffer_samples = ((int)size-10)/2;
-             int packet_size = (int)buffer[3];
-             buffer_size = size;
-             //Check if partial buffer
-             if(uart_buffer_samples != packet_size)
-             {
-                 //printk("Buffer incomplete - found %d, expected %d", uart_buffer_samples, packet_size);
-                 //Buffer size is incomplete
-                 memset(my_buffer, 0, 500);
-                 //Save partial packet from uart buffer to my_buffer
-                 memcpy(my_buffer, buffer, size);
-                 buffer_ready = false;
-                 buffer_frag = true;
-                 up(&my_semaphore);
-                 return size;
-             }
-             //Clear my_buffer
-             memset(my_buffer, 0, 500);
-             //Save uart buffer to my_buffer
-             memcpy(my_buffer, buffer, size);
-             //Release semaphore
-             //printk("Buffer size correct - found %d, expected %d", uart_buffer_samples, packet_size);
-             buffer_ready = true;
-             buffer_frag = false;
-             buffer_size = size;
-             up(&my_semaphore);
-             return size;
-         }
-         if(buffer_frag)
-         {
-             //copy fragment into buffer
-             if(buffer_size + size >= 500)
-             {
-                  goto InvalidBuf;
-             }
-             memcpy(my_buffer + buffer_size, buffer, size);
-             buffer_ready = true;
-             buffer_frag = false;
-             buffer_size += size;
-             up(&my_semaphore);
-             return size;
-         }
-
-InvalidBuf:
-         //Header not valid and buffer is not fragmented
-         memset(my_buffer, 0, 500);
-         buffer_ready = false;
-         buffer_frag = false;
-         buffer_size = 0;
-         up(&my_semaphore);
+         lidar_rx_feed(serdev_device_get_drvdata(serdev), buffer, size, ktime_get_boottime_ns());
+         //Every byte is consumed, partial frames are kept in lidar->rx until the next callback
          return size;
 }
 
@@ -293,43 +1000,315 @@ static const struct serdev_device_ops uart_driver_ops = {
 	.receive_buf = uart_driver_recv,
 };
 
+/*
+ * @brief Free the device once it has been removed and the last file using it is closed
+ */
+static void lidar_release(struct kref *ref)
+{
+        struct ydlidar *lidar = container_of(ref, struct ydlidar, ref);
+
+        //Pages still mapped into user space stay alive until unmapped
+        vfree(lidar->ring);
+        mutex_destroy(&lidar->read_lock);
+        mutex_destroy(&lidar->lock);
+        kfree(lidar);
+}
+
+static int driver_open(struct inode *inode, struct file *filp)
+{
+        struct ydlidar *lidar = NULL;
+        unsigned int minor = iminor(inode);
+
+        mutex_lock(&lidar_devices_lock);
+        if(minor < LIDAR_MAX_DEVICES)
+        {
+            lidar = lidar_devices[minor];
+        }
+        if(lidar)
+        {
+            kref_get(&lidar->ref);
+        }
+        mutex_unlock(&lidar_devices_lock);
+        if(!lidar)
+        {
+            return -ENODEV;
+        }
+        filp->private_data = lidar;
+        return 0;
+}
+
+static int driver_release(struct inode *inode, struct file *filp)
+{
+        struct ydlidar *lidar = filp->private_data;
+
+        kref_put(&lidar->ref, lidar_release);
+        return 0;
+}
+
+/*
+ * @brief Report the device readable while complete packets are queued
+ */
+/*
+ * @brief True if read() in the current format has something to return, safe to call without read_lock
+ * YDLIDAR_FMT_SCAN needs a complete revolution. A full ring or an invalid tail also count, the read recovers from them.
+ */
+static bool lidar_read_ready(struct ydlidar *lidar)
+{
+        struct lidar_ring *ring = lidar->ring;
+        unsigned int head, tail, start;
+
+        if(READ_ONCE(lidar->read_format) != YDLIDAR_FMT_SCAN)
+        {
+            return lidar_ring_ready(ring);
+        }
+        head = smp_load_acquire(&ring->ctrl.head);
+        if(!lidar_ring_tail_valid(ring, head, &tail) || head - tail >= LIDAR_RING_SLOTS)
+        {
+            return true;
+        }
+        return lidar_ring_scan(ring, tail, head, &start) != 0;
+}
+
+static __poll_t driver_poll(struct file *filp, poll_table *wait)
+{
+        struct ydlidar *lidar = filp->private_data;
+        __poll_t mask = 0;
+
+        poll_wait(filp, &lidar->read_wait, wait);
+        if(!READ_ONCE(lidar->serdev))
+        {
+            return EPOLLHUP | EPOLLERR;
+        }
+        if(lidar_read_ready(lidar))
+        {
+            mask |= EPOLLIN | EPOLLRDNORM;
+        }
+        //Packets left over from the last scan can still be read, after that read fails with -EINVAL.
+        //EPOLLERR alone means not scanning, only removal adds EPOLLHUP
+        else if(!READ_ONCE(lidar->scan_mode))
+        {
+            mask |= EPOLLERR;
+        }
+        return mask;
+}
+
+/*
+ * @brief Map the packet ring into user space for zero copy consumption, see struct ydlidar_ring_ctrl
+ */
+static int driver_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+        struct ydlidar *lidar = filp->private_data;
+
+        //The consumer has to write tail back, a private copy would never reach the driver
+        if(!(vma->vm_flags & VM_SHARED))
+        {
+	    pr_err("ydlidar_x4 - Error, packet ring must be mapped MAP_SHARED!");
+            return -EINVAL;
+        }
+        //Fails if the requested range is larger than the ring
+        return remap_vmalloc_range(vma, lidar->ring, vma->vm_pgoff);
+}
+
+static struct file_operations fops = {
+	.owner = THIS_MODULE,
+        .open = driver_open,
+        .release = driver_release,
+	.read = driver_read,
+        .poll = driver_poll,
+        .mmap = driver_mmap,
+        .unlocked_ioctl = driver_ioctl
+};
+
+/*
+ * @brief sysfs counters for monitoring link quality, e.g. /sys/class/UartClass/my_uart_driver/packets
+ */
+static ssize_t packets_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+        struct ydlidar *lidar = dev_get_drvdata(dev);
+
+        return sysfs_emit(buf, "%lu\n", READ_ONCE(lidar->rx.parser.packets));
+}
+static DEVICE_ATTR_RO(packets);
+
+static ssize_t bad_checksum_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+        struct ydlidar *lidar = dev_get_drvdata(dev);
+
+        return sysfs_emit(buf, "%lu\n", READ_ONCE(lidar->rx.parser.bad_checksum));
+}
+static DEVICE_ATTR_RO(bad_checksum);
+
+static ssize_t resyncs_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+        struct ydlidar *lidar = dev_get_drvdata(dev);
+
+        return sysfs_emit(buf, "%lu\n", READ_ONCE(lidar->rx.parser.resyncs));
+}
+static DEVICE_ATTR_RO(resyncs);
+
+static ssize_t overflows_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+        struct ydlidar *lidar = dev_get_drvdata(dev);
+
+        return sysfs_emit(buf, "%lu\n", READ_ONCE(lidar->stats.overflows));
+}
+static DEVICE_ATTR_RO(overflows);
+
+static struct attribute *lidar_attrs[] = {
+        &dev_attr_packets.attr,
+        &dev_attr_bad_checksum.attr,
+        &dev_attr_resyncs.attr,
+        &dev_attr_overflows.attr,
+        NULL,
+};
+ATTRIBUTE_GROUPS(lidar);
+
 /**
  * @brief This function is called on loading the driver
  */
 static int uart_driver_probe(struct serdev_device *serdev) {
+	struct ydlidar *lidar;
+	dev_t devt;
 	int status;
 	pr_info("ydlidar_x4_driver - probe function!\n");
 
+        lidar = kzalloc(sizeof(*lidar), GFP_KERNEL);
+        if(!lidar) {
+		return -ENOMEM;
+        }
+        kref_init(&lidar->ref);
+        mutex_init(&lidar->lock);
+        mutex_init(&lidar->read_lock);
+        init_waitqueue_head(&lidar->read_wait);
+        init_completion(&lidar->resp_done);
+        INIT_DELAYED_WORK(&lidar->freq_work, lidar_freq_work);
+        lidar->serdev = serdev;
+        lidar->read_format = YDLIDAR_FMT_PACKET;
+        lidar->rx.sample_period_ns = LIDAR_DEFAULT_SAMPLE_PERIOD_NS;
+
+        //Packet ring must exist before the port is opened and starts receiving
+        //vmalloc_user zeroes the ring and allows it to be remapped to user space
+        lidar->ring = vmalloc_user(sizeof(*lidar->ring));
+        if(!lidar->ring) {
+		pr_err("ydlidar_x4_driver - Could not allocate packet ring!\n");
+		status = -ENOMEM;
+		goto RingError;
+        }
+        lidar->ring->ctrl.slot_count = LIDAR_RING_SLOTS;
+        lidar->ring->ctrl.slot_size = sizeof(lidar->ring->slots[0]);
+        lidar->ring->ctrl.data_offset = offsetof(struct lidar_ring, slots);
+        lidar->ring->ctrl.map_size = PAGE_ALIGN(sizeof(*lidar->ring));
+
+        lidar->minor = ida_alloc_max(&lidar_minors, LIDAR_MAX_DEVICES - 1, GFP_KERNEL);
+        if(lidar->minor < 0) {
+		pr_err("ydlidar_x4_driver - No free minor for another lidar!\n");
+		status = lidar->minor;
+		goto RingError;
+        }
+        devt = MKDEV(MAJOR(my_device_nr), lidar->minor);
+
+        //Optional PWM on M_CTR for scan frequency control
+        lidar->motor_pwm = devm_pwm_get(&serdev->dev, NULL);
+        if(IS_ERR(lidar->motor_pwm)) {
+		status = PTR_ERR(lidar->motor_pwm);
+		lidar->motor_pwm = NULL;
+		if(status != -ENODEV && status != -ENOENT) {
+			pr_err("ydlidar_x4_driver - Could not get motor PWM!\n");
+			goto MinorError;
+		}
+        }
+
+	serdev_device_set_drvdata(serdev, lidar);
 	serdev_device_set_client_ops(serdev, &uart_driver_ops);
 	status = serdev_device_open(serdev);
 	if(status) {
 		pr_err("ydlidar_x4_driver - Error opening serial port!\n");
-		return -status;
+		goto MinorError;
 	}
-	serdev_device_set_baudrate(serdev, 128000);
+	serdev_device_set_baudrate(serdev, YDLIDAR_BAUDRATE);
 	serdev_device_set_flow_control(serdev, false);
 	serdev_device_set_parity(serdev, SERDEV_PARITY_NONE);
         //Ensure device is in stop mode
         serdev_device_write_buf(serdev, stop_scan_mode_command, 2);
-        //Set pointer to allow access to serdev from within ioctl
-        uartdev = serdev;
 
+        lidar->cdev = cdev_alloc();
+        if(!lidar->cdev) {
+		status = -ENOMEM;
+		goto OpenError;
+        }
+        lidar->cdev->owner = THIS_MODULE;
+        lidar->cdev->ops = &fops;
+	if(cdev_add(lidar->cdev, devt, 1)) {
+		pr_err("ydlidar_x4_driver - Registering of device to kernel failed!\n");
+		kobject_put(&lidar->cdev->kobj);
+		status = -EIO;
+		goto OpenError;
+	}
+
+        //First unit keeps the original node name so existing tools keep working
+        if(lidar->minor == 0)
+        {
+            lidar->dev = device_create_with_groups(my_class, &serdev->dev, devt, lidar, lidar_groups, DRIVER_NAME);
+        }
+        else
+        {
+            lidar->dev = device_create_with_groups(my_class, &serdev->dev, devt, lidar, lidar_groups, DRIVER_NAME "%d", lidar->minor);
+        }
+	if(IS_ERR(lidar->dev)) {
+		pr_err("ydlidar_x4_driver - Can not create device file!\n");
+		status = PTR_ERR(lidar->dev);
+		goto AddError;
+	}
+
+        mutex_lock(&lidar_devices_lock);
+        lidar_devices[lidar->minor] = lidar;
+        mutex_unlock(&lidar_devices_lock);
 	return 0;
+
+AddError:
+        cdev_del(lidar->cdev);
+OpenError:
+	serdev_device_close(serdev);
+MinorError:
+        ida_free(&lidar_minors, lidar->minor);
+RingError:
+        kref_put(&lidar->ref, lidar_release);
+	return status;
 }
 
 /**
  * @brief This function is called on unloading the driver
  */
 static void uart_driver_remove(struct serdev_device *serdev) {
+	struct ydlidar *lidar = serdev_device_get_drvdata(serdev);
 	pr_info("ydlidar_x4_driver - Now I am in the remove function\n");
+
+        //No new opens
+        mutex_lock(&lidar_devices_lock);
+        lidar_devices[lidar->minor] = NULL;
+        mutex_unlock(&lidar_devices_lock);
+        device_destroy(my_class, MKDEV(MAJOR(my_device_nr), lidar->minor));
+        cdev_del(lidar->cdev);
+
+        //Files that are still open see -ENODEV from now on
+        mutex_lock(&lidar->lock);
+        WRITE_ONCE(lidar->serdev, NULL);
+        if(lidar->scan_mode)
+        {
+            WRITE_ONCE(lidar->scan_mode, false);
+            serdev_device_write_buf(serdev, stop_scan_mode_command, 2);
+        }
+        lidar->target_mhz = 0;
+        mutex_unlock(&lidar->lock);
+        wake_up_interruptible(&lidar->read_wait);
+        //No ioctl can reach the port any more, so it is safe to close it
 	serdev_device_close(serdev);
-}
+        //Motor PWM is released with the serdev device, the loop must be gone before then
+        cancel_delayed_work_sync(&lidar->freq_work);
 
-static struct file_operations fops = {
-	.owner = THIS_MODULE,
-	.read = driver_read,
-        .unlocked_ioctl = driver_ioctl
-};
+        ida_free(&lidar_minors, lidar->minor);
+        kref_put(&lidar->ref, lidar_release);
+}
 
 /**
  * @brief This function is called, when the module is loaded into the kernel
@@ -337,17 +1316,13 @@ static struct file_operations fops = {
 static int __init my_init(void) {
 
 	pr_info("ydlidar_x4_driver - Loading the driver...\n");
-	if(serdev_device_driver_register(&uart_driver_driver)) {
-		printk("ydlidar_x4_driver - Error! Could not load driver\n");
-		return -1;
-	}
 
-	/* Allocate a device nr */
-	if( alloc_chrdev_region(&my_device_nr, 0, 1, DRIVER_NAME) < 0) {
+	/* Allocate a device nr for every unit */
+	if( alloc_chrdev_region(&my_device_nr, 0, LIDAR_MAX_DEVICES, DRIVER_NAME) < 0) {
 		pr_err("ydlidar_x4_driver - Device Nr. could not be allocated!\n");
 		return -1;
 	}
-	pr_info("ydlidar_x4_driver - read_write - Device Nr. Major: %d, Minor: %d was registered!\n", my_device_nr >> 20, my_device_nr && 0xfffff);
+	pr_info("ydlidar_x4_driver - read_write - Device Nr. Major: %d, Minor: %d was registered!\n", MAJOR(my_device_nr), MINOR(my_device_nr));
 
 	/* Create device class */
 	if((my_class = class_create(THIS_MODULE, DRIVER_CLASS)) == NULL) {
@@ -355,35 +1330,18 @@ static int __init my_init(void) {
 		goto ClassError;
 	}
 
-	/* create device file */
-	if(device_create(my_class, NULL, my_device_nr, NULL, DRIVER_NAME) == NULL) {
-		pr_err("ydlidar_x4_driver - Can not create device file!\n");
-		goto FileError;
-	}
-
-	/* Initialize device file */
-	cdev_init(&my_device, &fops);
-
-	/* Regisering device to kernel */
-	if(cdev_add(&my_device, my_device_nr, 1) == -1) {
-		pr_err("ydlidar_x4_driver - Registering of device to kernel failed!\n");
-		goto AddError;
+	/* Probe creates the device files, so register the driver last */
+	if(serdev_device_driver_register(&uart_driver_driver)) {
+		printk("ydlidar_x4_driver - Error! Could not load driver\n");
+		goto DriverError;
 	}
 
-        //initialize semaphore for lidar data buffer
-        sema_init(&my_semaphore, 1);
-
-        //to:do - use this buffer to fill with lidar data and write to user space
-        my_buffer = kmalloc(500, GFP_KERNEL);
-
 	return 0;
 
-AddError:
-	device_destroy(my_class, my_device_nr);
-FileError:
+DriverError:
 	class_destroy(my_class);
 ClassError:
-	unregister_chrdev_region(my_device_nr, 1);
+	unregister_chrdev_region(my_device_nr, LIDAR_MAX_DEVICES);
 	return -1;
 }
 
@@ -391,16 +1349,11 @@ ClassError:
  * @brief This function is called, when the module is removed from the kernel
  */
 static void __exit my_exit(void) {
-        //Free buffer
-        kfree(my_buffer);
-        //Set to null to avoid double freeing
-        my_buffer = NULL;
 	pr_info("ydlidar_x4_driver - Unload driver");
+	//Removes every unit and its device file
 	serdev_device_driver_unregister(&uart_driver_driver);
-        cdev_del(&my_device);
-	device_destroy(my_class, my_device_nr);
 	class_destroy(my_class);
-	unregister_chrdev_region(my_device_nr, 1);
+	unregister_chrdev_region(my_device_nr, LIDAR_MAX_DEVICES);
 	pr_info("ydlidar_x4_driver - Removing Module\n");
 }
 
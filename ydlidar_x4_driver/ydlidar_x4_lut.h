@@ -0,0 +1,326 @@
+/* Generated by gen_angle_lut.py, do not edit */
+#ifndef YDLIDAR_X4_LUT_H
+#define YDLIDAR_X4_LUT_H
+
+#define YDLIDAR_LUT_TIER0_END_Q2 1024
+#define YDLIDAR_LUT_TIER1_END_MM 2048
+#define YDLIDAR_LUT_TIER2_SHIFT 4
+#define YDLIDAR_LUT_TIER1_BASE 1024
+#define YDLIDAR_LUT_TIER2_BASE 2816
+#define YDLIDAR_LUT_SIZE 3712
+
+//Angle correction in 1/64 degree
+static const __s16 ydlidar_angle_correct_lut[YDLIDAR_LUT_SIZE] = {
+	0, 5718, 5676, 5633, 5591, 5548, 5506, 5463, 5420, 5377, 5335, 5292,
+	5249, 5206, 5163, 5120, 5077, 5035, 4992, 4949, 4907, 4864, 4822, 4780,
+	4738, 4696, 4654, 4612, 4571, 4529, 4488, 4447, 4406, 4366, 4325, 4285,
+	4245, 4206, 4166, 4127, 4088, 4050, 4012, 3973, 3936, 3898, 3861, 3824,
+	3788, 3751, 3715, 3680, 3644, 3609, 3575, 3540, 3506, 3472, 3439, 3406,
+	3373, 3341, 3309, 3277, 3245, 3214, 3183, 3153, 3123, 3093, 3063, 3034,
+	3005, 2977, 2948, 2920, 2893, 2865, 2838, 2812, 2785, 2759, 2733, 2708,
+	2683, 2658, 2633, 2609, 2584, 2561, 2537, 2514, 2491, 2468, 2446, 2423,
+	2401, 2380, 2358, 2337, 2316, 2295, 2275, 2255, 2235, 2215, 2195, 2176,
+	2157, 2138, 2120, 2101, 2083, 2065, 2047, 2030, 2012, 1995, 1978, 1961,
+	1944, 1928, 1912, 1896, 1880, 1864, 1849, 1833, 1818, 1803, 1788, 1774,
+	1759, 1745, 1730, 1716, 1703, 1689, 1675, 1662, 1648, 1635, 1622, 1609,
+	1597, 1584, 1572, 1559, 1547, 1535, 1523, 1511, 1499, 1488, 1476, 1465,
+	1454, 1443, 1432, 1421, 1410, 1399, 1389, 1378, 1368, 1358, 1347, 1337,
+	1327, 1318, 1308, 1298, 1289, 1279, 1270, 1260, 1251, 1242, 1233, 1224,
+	1215, 1206, 1198, 1189, 1181, 1172, 1164, 1155, 1147, 1139, 1131, 1123,
+	1115, 1107, 1099, 1092, 1084, 1076, 1069, 1061, 1054, 1047, 1039, 1032,
+	1025, 1018, 1011, 1004, 997, 990, 984, 977, 970, 964, 957, 951,
+	944, 938, 931, 925, 919, 913, 907, 901, 895, 889, 883, 877,
+	871, 865, 859, 854, 848, 842, 837, 831, 826, 820, 815, 810,
+	804, 799, 794, 789, 784, 778, 773, 768, 763, 758, 753, 749,
+	744, 739, 734, 729, 725, 720, 715, 711, 706, 702, 697, 693,
+	688, 684, 679, 675, 671, 667, 662, 658, 654, 650, 646, 641,
+	637, 633, 629, 625, 621, 617, 613, 609, 606, 602, 598, 594,
+	590, 587, 583, 579, 576, 572, 568, 565, 561, 558, 554, 551,
+	547, 544, 540, 537, 533, 530, 527, 523, 520, 517, 513, 510,
+	507, 504, 500, 497, 494, 491, 488, 485, 482, 479, 476, 473,
+	470, 467, 464, 461, 458, 455, 452, 449, 446, 443, 440, 438,
+	435, 432, 429, 427, 424, 421, 418, 416, 413, 410, 408, 405,
+	402, 400, 397, 395, 392, 390, 387, 385, 382, 380, 377, 375,
+	372, 370, 367, 365, 363, 360, 358, 355, 353, 351, 348, 346,
+	344, 342, 339, 337, 335, 333, 330, 328, 326, 324, 321, 319,
+	317, 315, 313, 311, 309, 307, 304, 302, 300, 298, 296, 294,
+	292, 290, 288, 286, 284, 282, 280, 278, 276, 274, 272, 270,
+	268, 267, 265, 263, 261, 259, 257, 255, 254, 252, 250, 248,
+	246, 244, 243, 241, 239, 237, 236, 234, 232, 230, 229, 227,
+	225, 223, 222, 220, 218, 217, 215, 213, 212, 210, 208, 207,
+	205, 204, 202, 200, 199, 197, 196, 194, 193, 191, 189, 188,
+	186, 185, 183, 182, 180, 179, 177, 176, 174, 173, 171, 170,
+	168, 167, 165, 164, 163, 161, 160, 158, 157, 156, 154, 153,
+	151, 150, 149, 147, 146, 144, 143, 142, 140, 139, 138, 136,
+	135, 134, 132, 131, 130, 129, 127, 126, 125, 123, 122, 121,
+	120, 118, 117, 116, 115, 113, 112, 111, 110, 109, 107, 106,
+	105, 104, 103, 101, 100, 99, 98, 97, 95, 94, 93, 92,
+	91, 90, 89, 87, 86, 85, 84, 83, 82, 81, 80, 78,
+	77, 76, 75, 74, 73, 72, 71, 70, 69, 68, 67, 66,
+	65, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53,
+	52, 51, 50, 49, 48, 47, 46, 45, 44, 43, 42, 41,
+	40, 39, 38, 38, 37, 36, 35, 34, 33, 32, 31, 30,
+	29, 28, 27, 26, 25, 24, 24, 23, 22, 21, 20, 19,
+	18, 17, 16, 16, 15, 14, 13, 12, 11, 10, 9, 9,
+	8, 7, 6, 5, 4, 4, 3, 2, 1, 0, -1, -1,
+	-2, -3, -4, -5, -6, -6, -7, -8, -9, -10, -10, -11,
+	-12, -13, -14, -14, -15, -16, -17, -17, -18, -19, -20, -21,
+	-21, -22, -23, -24, -24, -25, -26, -27, -27, -28, -29, -30,
+	-30, -31, -32, -32, -33, -34, -35, -35, -36, -37, -37, -38,
+	-39, -40, -40, -41, -42, -42, -43, -44, -45, -45, -46, -47,
+	-47, -48, -49, -49, -50, -51, -51, -52, -53, -53, -54, -55,
+	-55, -56, -57, -57, -58, -59, -59, -60, -61, -61, -62, -62,
+	-63, -64, -64, -65, -66, -66, -67, -68, -68, -69, -69, -70,
+	-71, -71, -72, -72, -73, -74, -74, -75, -76, -76, -77, -77,
+	-78, -78, -79, -80, -80, -81, -81, -82, -83, -83, -84, -84,
+	-85, -86, -86, -87, -87, -88, -88, -89, -90, -90, -91, -91,
+	-92, -92, -93, -93, -94, -95, -95, -96, -96, -97, -97, -98,
+	-98, -99, -99, -100, -101, -101, -102, -102, -103, -103, -104, -104,
+	-105, -105, -106, -106, -107, -107, -108, -108, -109, -109, -110, -110,
+	-111, -111, -112, -112, -113, -114, -114, -115, -115, -116, -116, -116,
+	-117, -117, -118, -118, -119, -119, -120, -120, -121, -121, -122, -122,
+	-123, -123, -124, -124, -125, -125, -126, -126, -127, -127, -128, -128,
+	-129, -129, -129, -130, -130, -131, -131, -132, -132, -133, -133, -134,
+	-134, -134, -135, -135, -136, -136, -137, -137, -138, -138, -138, -139,
+	-139, -140, -140, -141, -141, -142, -142, -142, -143, -143, -144, -144,
+	-145, -145, -145, -146, -146, -147, -147, -148, -148, -148, -149, -149,
+	-150, -150, -150, -151, -151, -152, -152, -153, -153, -153, -154, -154,
+	-155, -155, -155, -156, -156, -157, -157, -157, -158, -158, -159, -159,
+	-159, -160, -160, -161, -161, -161, -162, -162, -162, -163, -163, -164,
+	-164, -164, -165, -165, -166, -166, -166, -167, -167, -167, -168, -168,
+	-169, -169, -169, -170, -170, -170, -171, -171, -172, -172, -172, -173,
+	-173, -173, -174, -174, -174, -175, -175, -176, -176, -176, -177, -177,
+	-177, -178, -178, -178, -179, -179, -179, -180, -180, -180, -181, -181,
+	-182, -182, -182, -183, -183, -183, -184, -184, -184, -185, -185, -185,
+	-186, -186, -186, -187, -187, -187, -188, -188, -188, -189, -189, -189,
+	-190, -190, -190, -191, -191, -191, -192, -192, -192, -193, -193, -193,
+	-194, -194, -194, -194, -195, -195, -195, -196, -196, -196, -197, -197,
+	-197, -198, -198, -198, -199, -199, -199, -200, -200, -200, -200, -201,
+	-201, -201, -202, -202, -203, -204, -205, -206, -208, -209, -210, -211,
+	-212, -213, -214, -216, -217, -218, -219, -220, -221, -222, -223, -224,
+	-225, -226, -227, -228, -229, -230, -231, -232, -233, -234, -235, -236,
+	-237, -238, -239, -240, -241, -242, -243, -244, -245, -246, -246, -247,
+	-248, -249, -250, -251, -252, -253, -253, -254, -255, -256, -257, -258,
+	-258, -259, -260, -261, -262, -262, -263, -264, -265, -266, -266, -267,
+	-268, -269, -269, -270, -271, -272, -272, -273, -274, -274, -275, -276,
+	-277, -277, -278, -279, -279, -280, -281, -281, -282, -283, -283, -284,
+	-285, -285, -286, -287, -287, -288, -289, -289, -290, -290, -291, -292,
+	-292, -293, -294, -294, -295, -295, -296, -296, -297, -298, -298, -299,
+	-299, -300, -301, -301, -302, -302, -303, -303, -304, -304, -305, -306,
+	-306, -307, -307, -308, -308, -309, -309, -310, -310, -311, -311, -312,
+	-312, -313, -313, -314, -314, -315, -315, -316, -316, -317, -317, -318,
+	-318, -319, -319, -320, -320, -321, -321, -321, -322, -322, -323, -323,
+	-324, -324, -325, -325, -326, -326, -326, -327, -327, -328, -328, -329,
+	-329, -329, -330, -330, -331, -331, -331, -332, -332, -333, -333, -334,
+	-334, -334, -335, -335, -336, -336, -336, -337, -337, -337, -338, -338,
+	-339, -339, -339, -340, -340, -340, -341, -341, -342, -342, -342, -343,
+	-343, -343, -344, -344, -344, -345, -345, -346, -346, -346, -347, -347,
+	-347, -348, -348, -348, -349, -349, -349, -350, -350, -350, -351, -351,
+	-351, -352, -352, -352, -353, -353, -353, -354, -354, -354, -355, -355,
+	-355, -355, -356, -356, -356, -357, -357, -357, -358, -358, -358, -358,
+	-359, -359, -359, -360, -360, -360, -361, -361, -361, -361, -362, -362,
+	-362, -363, -363, -363, -363, -364, -364, -364, -364, -365, -365, -365,
+	-366, -366, -366, -366, -367, -367, -367, -367, -368, -368, -368, -369,
+	-369, -369, -369, -370, -370, -370, -370, -371, -371, -371, -371, -372,
+	-372, -372, -372, -373, -373, -373, -373, -374, -374, -374, -374, -374,
+	-375, -375, -375, -375, -376, -376, -376, -376, -377, -377, -377, -377,
+	-378, -378, -378, -378, -378, -379, -379, -379, -379, -380, -380, -380,
+	-380, -380, -381, -381, -381, -381, -382, -382, -382, -382, -382, -383,
+	-383, -383, -383, -383, -384, -384, -384, -384, -384, -385, -385, -385,
+	-385, -385, -386, -386, -386, -386, -386, -387, -387, -387, -387, -387,
+	-388, -388, -388, -388, -388, -389, -389, -389, -389, -389, -390, -390,
+	-390, -390, -390, -391, -391, -391, -391, -391, -391, -392, -392, -392,
+	-392, -392, -393, -393, -393, -393, -393, -393, -394, -394, -394, -394,
+	-394, -394, -395, -395, -395, -395, -395, -396, -396, -396, -396, -396,
+	-396, -397, -397, -397, -397, -397, -397, -398, -398, -398, -398, -398,
+	-398, -399, -399, -399, -399, -399, -399, -400, -400, -400, -400, -400,
+	-400, -400, -401, -401, -401, -401, -401, -401, -402, -402, -402, -402,
+	-402, -402, -402, -403, -403, -403, -403, -403, -403, -404, -404, -404,
+	-404, -404, -404, -404, -405, -405, -405, -405, -405, -405, -405, -406,
+	-406, -406, -406, -406, -406, -406, -407, -407, -407, -407, -407, -407,
+	-407, -408, -408, -408, -408, -408, -408, -408, -408, -409, -409, -409,
+	-409, -409, -409, -409, -410, -410, -410, -410, -410, -410, -410, -410,
+	-411, -411, -411, -411, -411, -411, -411, -411, -412, -412, -412, -412,
+	-412, -412, -412, -412, -413, -413, -413, -413, -413, -413, -413, -413,
+	-414, -414, -414, -414, -414, -414, -414, -414, -415, -415, -415, -415,
+	-415, -415, -415, -415, -416, -416, -416, -416, -416, -416, -416, -416,
+	-416, -417, -417, -417, -417, -417, -417, -417, -417, -417, -418, -418,
+	-418, -418, -418, -418, -418, -418, -418, -419, -419, -419, -419, -419,
+	-419, -419, -419, -419, -420, -420, -420, -420, -420, -420, -420, -420,
+	-420, -421, -421, -421, -421, -421, -421, -421, -421, -421, -421, -422,
+	-422, -422, -422, -422, -422, -422, -422, -422, -422, -423, -423, -423,
+	-423, -423, -423, -423, -423, -423, -423, -424, -424, -424, -424, -424,
+	-424, -424, -424, -424, -424, -425, -425, -425, -425, -425, -425, -425,
+	-425, -425, -425, -425, -426, -426, -426, -426, -426, -426, -426, -426,
+	-426, -426, -427, -427, -427, -427, -427, -427, -427, -427, -427, -427,
+	-427, -428, -428, -428, -428, -428, -428, -428, -428, -428, -428, -428,
+	-428, -429, -429, -429, -429, -429, -429, -429, -429, -429, -429, -429,
+	-430, -430, -430, -430, -430, -430, -430, -430, -430, -430, -430, -430,
+	-431, -431, -431, -431, -431, -431, -431, -431, -431, -431, -431, -431,
+	-432, -432, -432, -432, -432, -432, -432, -432, -432, -432, -432, -432,
+	-432, -433, -433, -433, -433, -433, -433, -433, -433, -433, -433, -433,
+	-433, -434, -434, -434, -434, -434, -434, -434, -434, -434, -434, -434,
+	-434, -434, -435, -435, -435, -435, -435, -435, -435, -435, -435, -435,
+	-435, -435, -435, -435, -436, -436, -436, -436, -436, -436, -436, -436,
+	-436, -436, -436, -436, -436, -436, -437, -437, -437, -437, -437, -437,
+	-437, -437, -437, -437, -437, -437, -437, -437, -438, -438, -438, -438,
+	-438, -438, -438, -438, -438, -438, -438, -438, -438, -438, -439, -439,
+	-439, -439, -439, -439, -439, -439, -439, -439, -439, -439, -439, -439,
+	-439, -440, -440, -440, -440, -440, -440, -440, -440, -440, -440, -440,
+	-440, -440, -440, -440, -440, -441, -441, -441, -441, -441, -441, -441,
+	-441, -441, -441, -441, -441, -441, -441, -441, -441, -442, -442, -442,
+	-442, -442, -442, -442, -442, -442, -442, -442, -442, -442, -442, -442,
+	-442, -443, -443, -443, -443, -443, -443, -443, -443, -443, -443, -443,
+	-443, -443, -443, -443, -443, -443, -444, -444, -444, -444, -444, -444,
+	-444, -444, -444, -444, -444, -444, -444, -444, -444, -444, -444, -445,
+	-445, -445, -445, -445, -445, -445, -445, -445, -445, -445, -445, -445,
+	-445, -445, -445, -445, -445, -446, -446, -446, -446, -446, -446, -446,
+	-446, -446, -446, -446, -446, -446, -446, -446, -446, -446, -446, -447,
+	-447, -447, -447, -447, -447, -447, -447, -447, -447, -447, -447, -447,
+	-447, -447, -447, -447, -447, -447, -448, -448, -448, -448, -448, -448,
+	-448, -448, -448, -448, -448, -448, -448, -448, -448, -448, -448, -448,
+	-448, -449, -449, -449, -449, -449, -449, -449, -449, -449, -449, -449,
+	-449, -449, -449, -449, -449, -449, -449, -449, -449, -449, -450, -450,
+	-450, -450, -450, -450, -450, -450, -450, -450, -450, -450, -450, -450,
+	-450, -450, -450, -450, -450, -450, -451, -451, -451, -451, -451, -451,
+	-451, -451, -451, -451, -451, -451, -451, -451, -451, -451, -451, -451,
+	-451, -451, -451, -451, -452, -452, -452, -452, -452, -452, -452, -452,
+	-452, -452, -452, -452, -452, -452, -452, -452, -452, -452, -452, -452,
+	-452, -452, -453, -453, -453, -453, -453, -453, -453, -453, -453, -453,
+	-453, -453, -453, -453, -453, -453, -453, -453, -453, -453, -453, -453,
+	-453, -454, -454, -454, -454, -454, -454, -454, -454, -454, -454, -454,
+	-454, -454, -454, -454, -454, -454, -454, -454, -454, -454, -454, -454,
+	-454, -455, -455, -455, -455, -455, -455, -455, -455, -455, -455, -455,
+	-455, -455, -455, -455, -455, -455, -455, -455, -455, -455, -455, -455,
+	-455, -456, -456, -456, -456, -456, -456, -456, -456, -456, -456, -456,
+	-456, -456, -456, -456, -456, -456, -456, -456, -456, -456, -456, -456,
+	-456, -456, -456, -457, -457, -457, -457, -457, -457, -457, -457, -457,
+	-457, -457, -457, -457, -457, -457, -457, -457, -457, -457, -457, -457,
+	-457, -457, -457, -457, -457, -457, -458, -458, -458, -458, -458, -458,
+	-458, -458, -458, -458, -458, -458, -458, -458, -458, -458, -458, -458,
+	-458, -458, -458, -458, -458, -458, -458, -458, -458, -459, -459, -459,
+	-459, -459, -459, -459, -459, -459, -459, -459, -459, -459, -459, -459,
+	-459, -459, -459, -459, -459, -459, -459, -459, -459, -459, -459, -459,
+	-459, -459, -460, -460, -460, -460, -460, -460, -460, -460, -460, -460,
+	-460, -460, -460, -460, -460, -460, -460, -460, -460, -460, -460, -460,
+	-460, -460, -460, -460, -460, -460, -460, -461, -461, -461, -461, -461,
+	-461, -461, -461, -461, -461, -461, -461, -461, -461, -461, -461, -461,
+	-461, -461, -461, -461, -461, -461, -461, -461, -461, -461, -461, -461,
+	-461, -461, -462, -462, -462, -462, -462, -462, -462, -462, -462, -462,
+	-462, -462, -462, -462, -462, -462, -462, -462, -462, -462, -462, -462,
+	-462, -462, -462, -462, -462, -462, -462, -462, -462, -462, -463, -463,
+	-463, -463, -463, -463, -463, -463, -463, -463, -463, -463, -463, -463,
+	-463, -463, -463, -463, -463, -463, -463, -463, -463, -463, -463, -463,
+	-463, -463, -463, -463, -463, -463, -463, -463, -464, -464, -464, -464,
+	-464, -464, -464, -464, -464, -464, -464, -464, -464, -464, -464, -464,
+	-464, -464, -464, -464, -464, -464, -464, -464, -464, -464, -464, -464,
+	-464, -464, -464, -464, -464, -464, -464, -465, -465, -465, -465, -465,
+	-465, -465, -465, -465, -465, -465, -465, -465, -465, -465, -465, -465,
+	-465, -465, -465, -465, -465, -465, -465, -465, -465, -465, -465, -465,
+	-465, -465, -465, -465, -465, -465, -465, -466, -466, -466, -466, -466,
+	-466, -466, -466, -466, -466, -466, -466, -466, -466, -466, -466, -466,
+	-466, -466, -466, -466, -466, -466, -466, -466, -466, -466, -466, -466,
+	-466, -466, -466, -466, -466, -466, -466, -466, -466, -467, -467, -467,
+	-467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467,
+	-467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467,
+	-467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467, -467,
+	-467, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468,
+	-468, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468,
+	-468, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468, -468,
+	-468, -468, -468, -468, -468, -468, -469, -469, -469, -469, -469, -469,
+	-469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469,
+	-469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469,
+	-469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469, -469,
+	-469, -469, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470,
+	-470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470,
+	-470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470,
+	-470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470, -470,
+	-471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471,
+	-471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471,
+	-471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471,
+	-471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471, -471,
+	-472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472,
+	-472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472,
+	-472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472,
+	-472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472, -472,
+	-472, -472, -473, -473, -473, -473, -473, -473, -473, -473, -473, -473,
+	-473, -473, -473, -473, -473, -473, -473, -473, -473, -473, -473, -473,
+	-473, -473, -473, -473, -473, -473, -473, -473, -473, -474, -474, -474,
+	-474, -475, -475, -475, -475, -476, -476, -476, -476, -477, -477, -477,
+	-477, -478, -478, -478, -478, -479, -479, -479, -479, -479, -480, -480,
+	-480, -480, -480, -481, -481, -481, -481, -481, -482, -482, -482, -482,
+	-482, -482, -483, -483, -483, -483, -483, -483, -484, -484, -484, -484,
+	-484, -484, -485, -485, -485, -485, -485, -485, -485, -486, -486, -486,
+	-486, -486, -486, -486, -486, -487, -487, -487, -487, -487, -487, -487,
+	-487, -488, -488, -488, -488, -488, -488, -488, -488, -488, -489, -489,
+	-489, -489, -489, -489, -489, -489, -489, -489, -490, -490, -490, -490,
+	-490, -490, -490, -490, -490, -490, -490, -491, -491, -491, -491, -491,
+	-491, -491, -491, -491, -491, -491, -492, -492, -492, -492, -492, -492,
+	-492, -492, -492, -492, -492, -492, -492, -493, -493, -493, -493, -493,
+	-493, -493, -493, -493, -493, -493, -493, -493, -493, -493, -494, -494,
+	-494, -494, -494, -494, -494, -494, -494, -494, -494, -494, -494, -494,
+	-494, -494, -495, -495, -495, -495, -495, -495, -495, -495, -495, -495,
+	-495, -495, -495, -495, -495, -495, -495, -495, -496, -496, -496, -496,
+	-496, -496, -496, -496, -496, -496, -496, -496, -496, -496, -496, -496,
+	-496, -496, -496, -496, -496, -497, -497, -497, -497, -497, -497, -497,
+	-497, -497, -497, -497, -497, -497, -497, -497, -497, -497, -497, -497,
+	-497, -497, -497, -497, -497, -498, -498, -498, -498, -498, -498, -498,
+	-498, -498, -498, -498, -498, -498, -498, -498, -498, -498, -498, -498,
+	-498, -498, -498, -498, -498, -498, -498, -498, -499, -499, -499, -499,
+	-499, -499, -499, -499, -499, -499, -499, -499, -499, -499, -499, -499,
+	-499, -499, -499, -499, -499, -499, -499, -499, -499, -499, -499, -499,
+	-499, -499, -499, -499, -500, -500, -500, -500, -500, -500, -500, -500,
+	-500, -500, -500, -500, -500, -500, -500, -500, -500, -500, -500, -500,
+	-500, -500, -500, -500, -500, -500, -500, -500, -500, -500, -500, -500,
+	-500, -500, -500, -500, -500, -500, -501, -501, -501, -501, -501, -501,
+	-501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501,
+	-501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501,
+	-501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501, -501,
+	-501, -501, -501, -502, -502, -502, -502, -502, -502, -502, -502, -502,
+	-502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502,
+	-502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502,
+	-502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502,
+	-502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -502, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503, -503,
+	-503, -503, -503, -503, -503, -503, -503, -503, -503, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504, -504,
+	-504, -504, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505, -505,
+	-505, -505, -505, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506, -506,
+	-506, -506, -506, -506, -507, -507, -507, -507, -507, -507, -507, -507,
+	-507, -507, -507, -507, -507, -507, -507, -507, -507, -507, -507, -507,
+	-507, -507, -507, -507,
+};
+
+#endif
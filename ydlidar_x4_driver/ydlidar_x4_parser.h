@@ -0,0 +1,323 @@
+#ifndef YDLIDAR_X4_PARSER_H
+#define YDLIDAR_X4_PARSER_H
+
+/*
+ * Streaming parser for the byte stream an X4 sends over its UART
+ * Shared between the driver's receive callback and user space tools reading a tty (userapp --tty, x4_emulator tests)
+ * Frames may be split across or packed into calls arbitrarily, ydlidar_parse stops at every completed frame
+ */
+
+#ifdef __KERNEL__
+#include <linux/kernel.h>
+#include <linux/string.h>
+//Counters are read locklessly through sysfs
+#define YDLIDAR_PARSER_COUNT(counter) WRITE_ONCE(counter, (counter) + 1)
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#define YDLIDAR_PARSER_COUNT(counter) ((counter)++)
+#endif
+
+#include "ydlidar_x4.h"
+
+//10 byte header followed by up to 255 16 bit samples (LSN is a single byte)
+//Header layout: PH (0x55AA little endian), CT, LSN, FSA, LSA, CS
+#define YDLIDAR_HEADER_SIZE 10
+//CT bit 0 marks the first packet of a revolution
+#define YDLIDAR_CT_START_BM 0x01
+#define YDLIDAR_PH_LOW 0xAA
+#define YDLIDAR_PH_HIGH 0x55
+#define YDLIDAR_CT_OFFSET 2
+#define YDLIDAR_LSN_OFFSET 3
+#define YDLIDAR_FSA_OFFSET 4
+#define YDLIDAR_LSA_OFFSET 6
+#define YDLIDAR_CS_OFFSET 8
+//Command replies start with a 7 byte response descriptor: A5 5A, 30 bit length + 2 bit mode (little endian), type
+#define YDLIDAR_RESP_SYNC_LOW 0xA5
+#define YDLIDAR_RESP_SYNC_HIGH 0x5A
+#define YDLIDAR_RESP_DESC_SIZE 7
+#define YDLIDAR_RESP_LEN_OFFSET 2
+#define YDLIDAR_RESP_LEN_BM 0x3FFFFFFF
+//Mode is the top 2 bits of the length word, continuous replies (scan start) carry no payload, the scan stream follows
+#define YDLIDAR_RESP_MODE_OFFSET 5
+#define YDLIDAR_RESP_MODE_BM 0xC0
+#define YDLIDAR_RESP_MODE_CONTINUOUS 0x40
+#define YDLIDAR_RESP_TYPE_OFFSET 6
+#define YDLIDAR_RESP_TYPE_INFO 0x04
+#define YDLIDAR_RESP_TYPE_HEALTH 0x06
+#define YDLIDAR_RESP_TYPE_SCAN 0x81
+#define YDLIDAR_RESP_INFO_SIZE 20
+#define YDLIDAR_RESP_HEALTH_SIZE 3
+#define YDLIDAR_RESP_MAX_SIZE YDLIDAR_RESP_INFO_SIZE
+//Commands are 0xA5 followed by one of these
+#define YDLIDAR_CMD_SYNC 0xA5
+#define YDLIDAR_CMD_START_SCAN 0x60
+#define YDLIDAR_CMD_STOP_SCAN 0x65
+#define YDLIDAR_CMD_DEVICE_INFO 0x90
+#define YDLIDAR_CMD_HEALTH 0x91
+#define YDLIDAR_CMD_REBOOT 0x80
+#define YDLIDAR_BAUDRATE 128000
+//8N1 framing, 10 bits on the wire per byte (78.125 us at 128000 baud)
+#define YDLIDAR_BYTE_NS (10 * 1000000000ULL / YDLIDAR_BAUDRATE)
+
+enum ydlidar_parser_state {
+        //Hunting for the first header byte (0xAA)
+        YDLIDAR_RX_SYNC_LOW,
+        //Hunting for the second header byte (0x55)
+        YDLIDAR_RX_SYNC_HIGH,
+        //Collecting the rest of the 10 byte header
+        YDLIDAR_RX_HEADER,
+        //Collecting 2 * LSN bytes of samples
+        YDLIDAR_RX_SAMPLES,
+        //Hunting for the second response descriptor byte (0x5A)
+        YDLIDAR_RX_RESP_SYNC,
+        //Collecting the rest of the 7 byte response descriptor
+        YDLIDAR_RX_RESP_DESC,
+        //Collecting the response payload
+        YDLIDAR_RX_RESP_DATA,
+};
+
+enum ydlidar_parse_result {
+        //Every byte was consumed without completing a frame
+        YDLIDAR_PARSE_MORE,
+        //frame holds a scan packet that passed the checksum
+        YDLIDAR_PARSE_PACKET,
+        //frame holds a response descriptor of type resp_type followed by its payload
+        YDLIDAR_PARSE_RESPONSE,
+};
+
+struct ydlidar_parser {
+        enum ydlidar_parser_state state;
+        //Bytes of frame collected so far
+        size_t len;
+        //Total frame length, known once LSN (or the response length) has been received
+        size_t expected;
+        //Framing was lost and has not yet been recovered by a good frame
+        bool lost;
+        //Response descriptor type to collect, 0 to ignore responses
+        //Set by the caller, only looked for while set because scan samples can contain A5 5A
+        __u8 resp_type;
+        //Arrival of the first byte of the current frame, in the clock passed to ydlidar_parse
+        __u64 timestamp_ns;
+        //Scan packets that passed the checksum
+        unsigned long packets;
+        //Complete frames dropped because the XOR checksum did not match
+        unsigned long bad_checksum;
+        //Times framing was lost and the parser had to hunt for a new header
+        unsigned long resyncs;
+        unsigned char frame[YDLIDAR_MAX_PACKET_SIZE];
+};
+
+static inline void ydlidar_parser_init(struct ydlidar_parser *p)
+{
+        memset(p, 0, sizeof(*p));
+}
+
+/*
+ * @brief Drop the partial frame and hunt for the next header
+ * Counted once per loss of framing, however many bytes it takes to recover
+ */
+static inline void ydlidar_parser_resync(struct ydlidar_parser *p)
+{
+        if(!p->lost)
+        {
+            p->lost = true;
+            YDLIDAR_PARSER_COUNT(p->resyncs);
+        }
+        p->state = YDLIDAR_RX_SYNC_LOW;
+        p->len = 0;
+        p->expected = 0;
+}
+
+/*
+ * @brief XOR of every 16 bit little endian word in the packet but CS itself
+ * @param len Whole packet, header included
+ */
+static inline __u16 ydlidar_packet_checksum(const unsigned char *frame, size_t len)
+{
+        __u16 cs = 0;
+        size_t i;
+
+        for(i = 0; i + 1 < len; i += 2)
+        {
+            if(i == YDLIDAR_CS_OFFSET)
+            {
+                continue;
+            }
+            cs ^= frame[i] | (frame[i + 1] << 8);
+        }
+        return cs;
+}
+
+static inline bool ydlidar_packet_valid(const unsigned char *frame, size_t len)
+{
+        return ydlidar_packet_checksum(frame, len) == (frame[YDLIDAR_CS_OFFSET] | (frame[YDLIDAR_CS_OFFSET + 1] << 8));
+}
+
+/*
+ * @brief Copy up to want - p->len bytes into the frame
+ * @return True once the frame holds want bytes
+ */
+static inline bool ydlidar_parser_collect(struct ydlidar_parser *p, const unsigned char *buffer, size_t size, size_t *i, size_t want)
+{
+        size_t chunk = size - *i < want - p->len ? size - *i : want - p->len;
+
+        memcpy(p->frame + p->len, buffer + *i, chunk);
+        p->len += chunk;
+        *i += chunk;
+        return p->len == want;
+}
+
+/*
+ * @brief Feed bytes through the state machine until a frame completes or the buffer runs out
+ * @param now_ns Arrival time of the last byte in buffer, frame timestamps step back from it by YDLIDAR_BYTE_NS per byte
+ * @param consumed Set to the number of bytes used, call again with the rest after handling a frame
+ * @return What completed, the frame stays valid until the next call
+ */
+static inline enum ydlidar_parse_result ydlidar_parse(struct ydlidar_parser *p, const unsigned char *buffer, size_t size,
+                                                      __u64 now_ns, size_t *consumed)
+{
+        enum ydlidar_parse_result result = YDLIDAR_PARSE_MORE;
+        size_t i = 0;
+
+        while(i < size && result == YDLIDAR_PARSE_MORE)
+        {
+            switch(p->state)
+            {
+            case YDLIDAR_RX_SYNC_LOW:
+                //Skip to the next possible header, or response descriptor while one is expected
+                if(buffer[i] != YDLIDAR_PH_LOW && !(p->resp_type && buffer[i] == YDLIDAR_RESP_SYNC_LOW))
+                {
+                    ydlidar_parser_resync(p);
+                }
+                while(i < size && buffer[i] != YDLIDAR_PH_LOW && !(p->resp_type && buffer[i] == YDLIDAR_RESP_SYNC_LOW))
+                {
+                    i++;
+                }
+                if(i == size)
+                {
+                    break;
+                }
+                if(buffer[i] == YDLIDAR_RESP_SYNC_LOW)
+                {
+                    p->frame[0] = buffer[i++];
+                    p->len = 1;
+                    p->state = YDLIDAR_RX_RESP_SYNC;
+                    break;
+                }
+                //now_ns is when the last byte of the buffer arrived, step back to this byte
+                p->timestamp_ns = now_ns - (__u64)(size - 1 - i) * YDLIDAR_BYTE_NS;
+                p->frame[0] = buffer[i++];
+                p->len = 1;
+                p->state = YDLIDAR_RX_SYNC_HIGH;
+                break;
+            case YDLIDAR_RX_SYNC_HIGH:
+                if(buffer[i] == YDLIDAR_PH_HIGH)
+                {
+                    p->frame[p->len++] = buffer[i++];
+                    p->state = YDLIDAR_RX_HEADER;
+                }
+                else if(buffer[i] != YDLIDAR_PH_LOW)
+                {
+                    //Not a header, a repeated 0xAA could still start one
+                    ydlidar_parser_resync(p);
+                    i++;
+                }
+                else
+                {
+                    p->timestamp_ns = now_ns - (__u64)(size - 1 - i) * YDLIDAR_BYTE_NS;
+                    i++;
+                }
+                break;
+            case YDLIDAR_RX_HEADER:
+                if(!ydlidar_parser_collect(p, buffer, size, &i, YDLIDAR_HEADER_SIZE))
+                {
+                    break;
+                }
+                //Every packet carries at least one sample, anything else was a false header
+                if(p->frame[YDLIDAR_LSN_OFFSET] == 0)
+                {
+                    ydlidar_parser_resync(p);
+                    break;
+                }
+                p->expected = YDLIDAR_HEADER_SIZE + 2 * (size_t)p->frame[YDLIDAR_LSN_OFFSET];
+                p->state = YDLIDAR_RX_SAMPLES;
+                break;
+            case YDLIDAR_RX_SAMPLES:
+                if(!ydlidar_parser_collect(p, buffer, size, &i, p->expected))
+                {
+                    break;
+                }
+                if(!ydlidar_packet_valid(p->frame, p->len))
+                {
+                    //Corrupt frame, or a false header whose LSN was garbage
+                    YDLIDAR_PARSER_COUNT(p->bad_checksum);
+                    ydlidar_parser_resync(p);
+                    break;
+                }
+                YDLIDAR_PARSER_COUNT(p->packets);
+                p->lost = false;
+                p->state = YDLIDAR_RX_SYNC_LOW;
+                result = YDLIDAR_PARSE_PACKET;
+                break;
+            case YDLIDAR_RX_RESP_SYNC:
+                if(buffer[i] == YDLIDAR_RESP_SYNC_HIGH)
+                {
+                    p->frame[p->len++] = buffer[i++];
+                    p->state = YDLIDAR_RX_RESP_DESC;
+                }
+                else if(buffer[i] != YDLIDAR_RESP_SYNC_LOW)
+                {
+                    ydlidar_parser_resync(p);
+                    i++;
+                }
+                else
+                {
+                    i++;
+                }
+                break;
+            case YDLIDAR_RX_RESP_DESC:
+                if(!ydlidar_parser_collect(p, buffer, size, &i, YDLIDAR_RESP_DESC_SIZE))
+                {
+                    break;
+                }
+                p->expected = (p->frame[YDLIDAR_RESP_LEN_OFFSET] | (p->frame[YDLIDAR_RESP_LEN_OFFSET + 1] << 8) |
+                               (p->frame[YDLIDAR_RESP_LEN_OFFSET + 2] << 16) |
+                               ((__u32)p->frame[YDLIDAR_RESP_LEN_OFFSET + 3] << 24)) & YDLIDAR_RESP_LEN_BM;
+                if(p->frame[YDLIDAR_RESP_MODE_OFFSET] & YDLIDAR_RESP_MODE_BM)
+                {
+                    p->expected = 0;
+                }
+                //Only the reply the caller asked for is collected
+                if(p->frame[YDLIDAR_RESP_TYPE_OFFSET] != p->resp_type || p->expected > YDLIDAR_RESP_MAX_SIZE ||
+                   (p->expected == 0 && !(p->frame[YDLIDAR_RESP_MODE_OFFSET] & YDLIDAR_RESP_MODE_BM)))
+                {
+                    ydlidar_parser_resync(p);
+                    break;
+                }
+                p->expected += YDLIDAR_RESP_DESC_SIZE;
+                p->state = YDLIDAR_RX_RESP_DATA;
+                if(p->len == p->expected)
+                {
+                    p->lost = false;
+                    p->state = YDLIDAR_RX_SYNC_LOW;
+                    result = YDLIDAR_PARSE_RESPONSE;
+                }
+                break;
+            case YDLIDAR_RX_RESP_DATA:
+                if(!ydlidar_parser_collect(p, buffer, size, &i, p->expected))
+                {
+                    break;
+                }
+                p->lost = false;
+                p->state = YDLIDAR_RX_SYNC_LOW;
+                result = YDLIDAR_PARSE_RESPONSE;
+                break;
+            }
+        }
+        *consumed = i;
+        return result;
+}
+
+#endif
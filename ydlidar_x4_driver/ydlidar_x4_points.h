@@ -0,0 +1,112 @@
+#ifndef YDLIDAR_X4_POINTS_H
+#define YDLIDAR_X4_POINTS_H
+
+/*
+ * Fixed point decoding of X4 scan packets into (distance, angle) points
+ * Shared between the driver (YDLIDAR_FMT_POINTS) and user space, no floating point or trig
+ */
+
+#include "ydlidar_x4.h"
+#include "ydlidar_x4_parser.h"
+#include "ydlidar_x4_lut.h"
+
+//One full turn in 1/64 degree
+#define YDLIDAR_ANGLE_Q6_FULL (360 * 64)
+
+/*
+ * @brief X4 angle correction for a sample, looked up from the q2 distance
+ * @return Correction in 1/64 degree
+ */
+static inline __s16 ydlidar_angle_correct_q6(__u16 distance_q2)
+{
+        unsigned int mm;
+
+        if(distance_q2 < YDLIDAR_LUT_TIER0_END_Q2)
+        {
+            return ydlidar_angle_correct_lut[distance_q2];
+        }
+        mm = distance_q2 >> 2;
+        if(mm < YDLIDAR_LUT_TIER1_END_MM)
+        {
+            return ydlidar_angle_correct_lut[YDLIDAR_LUT_TIER1_BASE + mm - YDLIDAR_LUT_TIER0_END_Q2 / 4];
+        }
+        return ydlidar_angle_correct_lut[YDLIDAR_LUT_TIER2_BASE + ((mm - YDLIDAR_LUT_TIER1_END_MM) >> YDLIDAR_LUT_TIER2_SHIFT)];
+}
+
+/*
+ * @brief Validate a raw scan packet and read the angles its samples are interpolated between
+ * @param fsa Receives the first sample angle in 1/64 degree
+ * @param diff Receives the angle from the first to the last sample in 1/64 degree, wrapped past 360 degrees
+ * @return LSN, or -1 if the packet is malformed
+ */
+static inline int ydlidar_packet_angles(const __u8 *packet, unsigned int len, int *fsa, int *diff)
+{
+        unsigned int lsn;
+        int lsa;
+
+        if(len < YDLIDAR_HEADER_SIZE)
+        {
+            return -1;
+        }
+        lsn = packet[YDLIDAR_LSN_OFFSET];
+        if(lsn == 0 || len < YDLIDAR_HEADER_SIZE + 2 * lsn)
+        {
+            return -1;
+        }
+        //Bit 0 of FSA and LSA is a check bit, the rest is the angle in 1/64 degree
+        *fsa = (packet[YDLIDAR_FSA_OFFSET] | (packet[YDLIDAR_FSA_OFFSET + 1] << 8)) >> 1;
+        lsa = (packet[YDLIDAR_LSA_OFFSET] | (packet[YDLIDAR_LSA_OFFSET + 1] << 8)) >> 1;
+        //Last angle wraps past 360 degrees
+        *diff = lsa - *fsa;
+        if(*diff < 0)
+        {
+            *diff += YDLIDAR_ANGLE_Q6_FULL;
+        }
+        return lsn;
+}
+
+//Raw distance of sample i in 1/4 mm
+static inline __u16 ydlidar_sample_q2(const __u8 *packet, unsigned int i)
+{
+        return packet[YDLIDAR_HEADER_SIZE + 2 * i] | (packet[YDLIDAR_HEADER_SIZE + 1 + 2 * i] << 8);
+}
+
+/*
+ * @brief Corrected angle of sample i of lsn, see ydlidar_packet_angles for fsa and diff
+ * @return Angle in 1/64 degree, normalized to 0-360 degrees
+ */
+static inline int ydlidar_sample_angle_q6(int fsa, int diff, unsigned int lsn, unsigned int i, __u16 distance_q2)
+{
+        int angle = fsa + ydlidar_angle_correct_q6(distance_q2);
+
+        if(lsn > 1)
+        {
+            angle += diff * (int)i / (int)(lsn - 1);
+        }
+        angle %= YDLIDAR_ANGLE_Q6_FULL;
+        if(angle < 0)
+        {
+            angle += YDLIDAR_ANGLE_Q6_FULL;
+        }
+        return angle;
+}
+
+/*
+ * @brief Decode a raw scan packet, interpolating sample angles between FSA and LSA and applying the angle correction
+ * @param points Room for at least LSN (packet[3]) points
+ * @return Number of points decoded, or -1 if the packet is malformed
+ */
+static inline int ydlidar_decode_points(const __u8 *packet, unsigned int len, struct ydlidar_point *points)
+{
+        int lsn, i, fsa, diff;
+
+        lsn = ydlidar_packet_angles(packet, len, &fsa, &diff);
+        for(i = 0; i < lsn; i++)
+        {
+            points[i].distance_q2 = ydlidar_sample_q2(packet, i);
+            points[i].angle_q6 = ydlidar_sample_angle_q6(fsa, diff, lsn, i, points[i].distance_q2);
+        }
+        return lsn;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef YDLIDAR_X4_QUEUE_H
+#define YDLIDAR_X4_QUEUE_H
+
+/*
+ * Single producer / single consumer queue of fixed size slots for the user space pipeline threads
+ * Same scheme as the driver's packet ring: head is only written by the producer, tail only by the consumer.
+ * An empty queue puts the consumer to sleep on a futex, the producer only pays for a wake up while it sleeps.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+struct spsc_queue {
+    _Atomic uint32_t head;
+    _Atomic uint32_t tail;
+    //Consumer is (about to be) asleep in spsc_wait
+    _Atomic uint32_t sleeping;
+    //Deepest the queue got since spsc_peak_depth was last called
+    _Atomic uint32_t peak;
+    //Number of slots, a power of 2
+    uint32_t slots;
+    size_t slot_size;
+    unsigned char *data;
+};
+
+/*
+ * @return 0, or -1 if the slots could not be allocated
+ */
+static inline int spsc_init(struct spsc_queue *q, uint32_t slots, size_t slot_size)
+{
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->sleeping, 0);
+    atomic_init(&q->peak, 0);
+    q->slots = slots;
+    q->slot_size = slot_size;
+    q->data = calloc(slots, slot_size);
+    return q->data ? 0 : -1;
+}
+
+static inline void spsc_free(struct spsc_queue *q)
+{
+    free(q->data);
+    q->data = NULL;
+}
+
+static inline uint32_t spsc_depth(struct spsc_queue *q)
+{
+    return atomic_load_explicit(&q->head, memory_order_acquire) - atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+/*
+ * @brief Deepest the queue has been since the last call
+ */
+static inline uint32_t spsc_peak_depth(struct spsc_queue *q)
+{
+    return atomic_exchange_explicit(&q->peak, 0, memory_order_relaxed);
+}
+
+/*
+ * @brief Producer side, slot to fill or NULL if the queue is full
+ */
+static inline void *spsc_reserve(struct spsc_queue *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    //Pairs with the release in spsc_release, the slot is free once tail has moved past it
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+
+    if(head - tail >= q->slots)
+    {
+        return NULL;
+    }
+    return q->data + (size_t)(head & (q->slots - 1)) * q->slot_size;
+}
+
+/*
+ * @brief Producer side, hand the slot returned by spsc_reserve to the consumer
+ */
+static inline void spsc_publish(struct spsc_queue *q)
+{
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed) + 1;
+    uint32_t depth = head - atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&q->head, head, memory_order_release);
+    if(depth > atomic_load_explicit(&q->peak, memory_order_relaxed))
+    {
+        atomic_store_explicit(&q->peak, depth, memory_order_relaxed);
+    }
+    //Orders the head store before the sleeping load, pairs with the fence in spsc_wait
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load_explicit(&q->sleeping, memory_order_relaxed))
+    {
+        syscall(SYS_futex, &q->head, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+/*
+ * @brief Consumer side, oldest slot or NULL if the queue is empty
+ */
+static inline void *spsc_peek(struct spsc_queue *q)
+{
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if(atomic_load_explicit(&q->head, memory_order_acquire) == tail)
+    {
+        return NULL;
+    }
+    return q->data + (size_t)(tail & (q->slots - 1)) * q->slot_size;
+}
+
+/*
+ * @brief Consumer side, hand the slot returned by spsc_peek back to the producer
+ */
+static inline void spsc_release(struct spsc_queue *q)
+{
+    atomic_store_explicit(&q->tail, atomic_load_explicit(&q->tail, memory_order_relaxed) + 1, memory_order_release);
+}
+
+/*
+ * @brief Consumer side, sleep until the queue is not empty or timeout_ms passes
+ */
+static inline void spsc_wait(struct spsc_queue *q, int timeout_ms)
+{
+    struct timespec timeout = {timeout_ms / 1000, (timeout_ms % 1000) * 1000000L};
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&q->sleeping, 1, memory_order_relaxed);
+    //Orders the sleeping store before the head load, pairs with the fence in spsc_publish
+    atomic_thread_fence(memory_order_seq_cst);
+    //The kernel rechecks head == tail atomically, so a publish between here and the wait is not missed
+    if(atomic_load_explicit(&q->head, memory_order_relaxed) == tail)
+    {
+        syscall(SYS_futex, &q->head, FUTEX_WAIT_PRIVATE, tail, &timeout, NULL, 0);
+    }
+    atomic_store_explicit(&q->sleeping, 0, memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef YDLIDAR_X4_UDP_H
+#define YDLIDAR_X4_UDP_H
+
+/*
+ * Wire format of the UDP point stream sent by userapp to YDLIDAR_X4_GUI.py
+ * One datagram carries one lidar packet: struct ydlidar_udp_header followed by count struct ydlidar_udp_point
+ * All fields are little endian and there is no padding
+ */
+
+#include <stdint.h>
+
+//"YDX4" read as a little endian 32 bit value
+#define YDLIDAR_UDP_MAGIC 0x34584459
+//Bump whenever the layout below changes, receivers drop versions they do not know
+#define YDLIDAR_UDP_VERSION 1
+
+//Datagram carries the first packet of a revolution
+#define YDLIDAR_UDP_START_OF_SCAN 0x01
+
+//An X4 packet never carries more than 255 samples (LSN is a single byte)
+#define YDLIDAR_UDP_MAX_POINTS 255
+
+struct ydlidar_udp_header {
+        uint32_t magic;
+        uint8_t version;
+        //YDLIDAR_UDP_* flags
+        uint8_t flags;
+        //Number of points following the header
+        uint16_t count;
+        //Incremented for every datagram, gaps tell the receiver how many were lost
+        uint32_t seq;
+        //CLOCK_BOOTTIME of the lidar packet on the sender
+        uint64_t timestamp_ns;
+} __attribute__((packed));
+
+struct ydlidar_udp_point {
+        //Distance in 1/4 mm, 0 when the sample is invalid
+        uint16_t distance_q2;
+        //Corrected angle in 1/64 degree, 0 to 360 degrees
+        int16_t angle_q6;
+} __attribute__((packed));
+
+#define YDLIDAR_UDP_MAX_DATAGRAM (sizeof(struct ydlidar_udp_header) + YDLIDAR_UDP_MAX_POINTS * sizeof(struct ydlidar_udp_point))
+
+#endif